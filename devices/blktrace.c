@@ -0,0 +1,179 @@
+#include "devices/blktrace.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* Block request tracing.
+
+   When enabled with the -blktrace kernel option, every request
+   that reaches a block device driver's queue is recorded in a ring
+   buffer, which keeps the most recent ones.  At shutdown, the
+   buffer is appended to the ustar archive on the scratch device
+   as a text file named "blktrace", one request per line:
+
+        CYCLES TID DEVICE R|W SECTOR COUNT
+
+   where CYCLES is the CPU's time-stamp counter at submission and
+   TID is the submitting thread, or -1 for a request submitted by
+   an interrupt handler.  Requests to partitions are recorded
+   after translation, with the underlying device's name and
+   sector number.  utils/blktrace analyzes the result. */
+
+/* A recorded request. */
+struct trace_entry
+  {
+    uint64_t cycles;            /* Time-stamp counter at submission. */
+    struct block *block;        /* Device. */
+    block_sector_t sector;      /* First sector. */
+    block_sector_t cnt;         /* Number of sectors. */
+    tid_t tid;                  /* Submitting thread, or -1. */
+    bool write;                 /* Write (true) or read (false)? */
+  };
+
+/* Ring buffer of recorded requests. */
+static struct trace_entry *ring;
+static size_t ring_size;        /* Number of entries in RING. */
+static unsigned long long recorded;     /* Requests ever recorded. */
+static bool tracing;            /* Recording requests? */
+
+/* Turns on tracing of the last ENTRIES block requests. */
+void
+blktrace_init (size_t entries)
+{
+  ASSERT (entries > 0);
+
+  ring = malloc (entries * sizeof *ring);
+  if (ring == NULL)
+    PANIC ("Failed to allocate %zu-entry block trace buffer", entries);
+  ring_size = entries;
+  recorded = 0;
+  tracing = true;
+}
+
+/* Records REQ, which has just been queued on its device.  Must be
+   called with interrupts off. */
+void
+blktrace_record (const struct block_request *req)
+{
+  struct trace_entry *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!tracing)
+    return;
+
+  e = &ring[recorded++ % ring_size];
+  e->cycles = req->submitted;
+  e->block = req->block;
+  e->sector = req->sector;
+  e->cnt = req->cnt;
+  e->tid = intr_context () ? -1 : thread_current ()->tid;
+  e->write = req->write;
+}
+
+#ifdef FILESYS
+/* State of a dump in progress. */
+struct dump
+  {
+    unsigned long long next;    /* Next entry to format. */
+    char line[80];              /* Current line. */
+    size_t line_len;            /* Length of LINE. */
+    size_t line_ofs;            /* Bytes of LINE already copied out. */
+  };
+
+/* Returns the number of entries still in the ring buffer. */
+static size_t
+entry_cnt (void)
+{
+  return recorded < ring_size ? recorded : ring_size;
+}
+
+/* Formats the Ith line of the dump, counting the header line as
+   line 0, into LINE, which must have room for 80 bytes.  Returns
+   its length. */
+static size_t
+format_line (unsigned long long i, char *line)
+{
+  const struct trace_entry *e;
+
+  if (i == 0)
+    return snprintf (line, 80, "# blktrace: %zu of %llu requests\n",
+                     entry_cnt (), recorded);
+
+  e = &ring[(recorded - entry_cnt () + i - 1) % ring_size];
+  return snprintf (line, 80, "%llu %d %s %c %"PRDSNu" %"PRDSNu"\n",
+                   e->cycles, e->tid, block_name (e->block),
+                   e->write ? 'W' : 'R', e->sector, e->cnt);
+}
+
+/* Copies the next SIZE bytes of the dump in DUMP_ into
+   BUFFER. */
+static void
+read_dump (void *dump_, void *buffer_, size_t size)
+{
+  struct dump *dump = dump_;
+  char *buffer = buffer_;
+
+  while (size > 0)
+    {
+      size_t chunk;
+
+      if (dump->line_ofs == dump->line_len)
+        {
+          dump->line_len = format_line (dump->next++, dump->line);
+          dump->line_ofs = 0;
+        }
+
+      chunk = dump->line_len - dump->line_ofs;
+      if (chunk > size)
+        chunk = size;
+      memcpy (buffer, dump->line + dump->line_ofs, chunk);
+      dump->line_ofs += chunk;
+      buffer += chunk;
+      size -= chunk;
+    }
+}
+
+/* Appends the trace, if tracing is on, to the scratch device as
+   file "blktrace", and turns tracing off.  Only in kernels with a
+   file system, which provides the scratch device. */
+void
+blktrace_dump (void)
+{
+  enum intr_level old_level;
+  struct dump dump;
+  char line[80];
+  off_t size;
+  unsigned long long i;
+
+  /* Writing requires sleeping, which is impossible with interrupts
+     off, as after a kernel panic. */
+  if (!tracing || intr_get_level () == INTR_OFF)
+    return;
+
+  /* Stop tracing, so that the dump neither traces itself nor
+     changes under us. */
+  old_level = intr_disable ();
+  tracing = false;
+  intr_set_level (old_level);
+
+  /* Format everything once to find the file's size. */
+  size = 0;
+  for (i = 0; i <= entry_cnt (); i++)
+    size += format_line (i, line);
+
+  printf ("Appending block trace to ustar archive on scratch device...\n");
+  dump.next = 0;
+  dump.line_len = dump.line_ofs = 0;
+  fsutil_append_data ("blktrace", size, read_dump, &dump);
+
+  free (ring);
+  ring = NULL;
+}
+#endif /* FILESYS */
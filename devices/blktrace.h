@@ -0,0 +1,15 @@
+#ifndef DEVICES_BLKTRACE_H
+#define DEVICES_BLKTRACE_H
+
+#include <stddef.h>
+
+struct block_request;
+
+/* Default number of requests to keep. */
+#define BLKTRACE_DEFAULT 4096
+
+void blktrace_init (size_t entries);
+void blktrace_record (const struct block_request *);
+void blktrace_dump (void);
+
+#endif /* devices/blktrace.h */
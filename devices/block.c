@@ -2,7 +2,10 @@
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
+#include "devices/blktrace.h"
 #include "devices/ide.h"
+#include "devices/iosched.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 
 /* A block device. */
@@ -17,8 +20,14 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    struct iosched_queue queue;         /* Requests waiting to start. */
+    bool busy;                          /* Driver has a request? */
+
+    struct blkstat stats;               /* Statistics. */
+    unsigned in_flight;                 /* Requests submitted and not
+                                           yet completed. */
+    block_sector_t last_end;            /* Sector after the last one
+                                           passed to the driver. */
   };
 
 /* List of all block devices. */
@@ -28,6 +37,19 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void dispatch (struct block *);
+static void account_completion (struct block_request *);
+static void print_latency (const struct blkstat *);
+
+/* Returns the CPU's time-stamp counter, which counts clock
+   cycles. */
+static inline uint64_t
+read_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -99,17 +121,18 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Verifies that the CNT sectors starting at SECTOR are valid
+   offsets within BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sector (struct block *block, block_sector_t sector, block_sector_t cnt)
 {
-  if (sector >= block->size)
+  if (sector >= block->size || cnt > block->size - sector)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
       PANIC ("Access past end of device %s (sector=%"PRDSNu", "
-             "size=%"PRDSNu")\n", block_name (block), sector, block->size);
+             "cnt=%"PRDSNu", size=%"PRDSNu")\n",
+             block_name (block), sector, cnt, block->size);
     }
 }
 
@@ -120,9 +143,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_range (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +154,181 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_range (block, sector, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes,
+   as a single request. */
+void
+block_read_range (struct block *block, block_sector_t sector,
+                  block_sector_t cnt, void *buffer)
+{
+  struct block_request req;
+
+  block_request_init (&req, block, false, sector, cnt, buffer, NULL, NULL);
+  block_submit (&req);
+  block_wait (&req);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes, as a single
+   request.  Returns after the block device has acknowledged
+   receiving the data. */
+void
+block_write_range (struct block *block, block_sector_t sector,
+                   block_sector_t cnt, const void *buffer)
+{
+  struct block_request req;
+
+  block_request_init (&req, block, true, sector, cnt, (void *) buffer,
+                      NULL, NULL);
+  block_submit (&req);
+  block_wait (&req);
+}
+
+/* Initializes REQ as a request to transfer the CNT sectors
+   starting at SECTOR between BLOCK and BUFFER, reading into BUFFER
+   if WRITE is false or writing from it if WRITE is true.
+
+   If DONE is non-null, it is called with REQ when the transfer
+   completes, and AUX is available to it in REQ->aux.  Otherwise,
+   the caller must wait for the transfer with block_wait(). */
+void
+block_request_init (struct block_request *req, struct block *block,
+                    bool write, block_sector_t sector, block_sector_t cnt,
+                    void *buffer, block_done_func *done, void *aux)
+{
+  ASSERT (req != NULL);
+  ASSERT (block != NULL);
+  ASSERT (cnt > 0);
+
+  req->block = block;
+  req->write = write;
+  req->sector = sector;
+  req->cnt = cnt;
+  req->buffer = buffer;
+  req->seg_cnt = cnt;
+  req->merged = NULL;
+  req->deadline = 0;
+  req->done = done;
+  req->aux = aux;
+  sema_init (&req->finished, 0);
+}
+
+/* Queues REQ on its device and returns without waiting for it to
+   complete.  REQ and its buffer must remain valid until then.
+   May be called from an interrupt handler. */
+void
+block_submit (struct block_request *req)
+{
+  struct block *block = req->block;
+  enum intr_level old_level;
+
+  ASSERT (!req->write || block->type != BLOCK_FOREIGN);
+
+  old_level = intr_disable ();
+  for (;;)
+    {
+      check_sector (block, req->sector, req->cnt);
+      if (req->write)
+        block->stats.write_cnt += req->cnt;
+      else
+        block->stats.read_cnt += req->cnt;
+      if (block->ops->remap == NULL)
+        break;
+      block = req->block = block->ops->remap (block->aux, &req->sector);
+    }
+
+  block->stats.depth_samples++;
+  block->stats.depth_sum += block->in_flight;
+  if (block->in_flight > block->stats.depth_max)
+    block->stats.depth_max = block->in_flight;
+  block->in_flight++;
+  req->submitted = read_tsc ();
+  blktrace_record (req);
+
+  iosched_add (&block->queue, req);
+  dispatch (block);
+  intr_set_level (old_level);
+}
+
+/* Waits for REQ, which must have been submitted without a
+   completion callback, to complete. */
+void
+block_wait (struct block_request *req)
+{
+  ASSERT (req->done == NULL);
+  sema_down (&req->finished);
+}
+
+/* Returns the address of sector OFS of REQ's data, taking
+   merged requests into account.  If RUN is non-null, stores in
+   *RUN the number of sectors, starting there, that are contiguous
+   in memory. */
+void *
+block_request_buffer (const struct block_request *req, block_sector_t ofs,
+                      block_sector_t *run)
+{
+  ASSERT (ofs < req->cnt);
+
+  while (ofs >= req->seg_cnt)
+    {
+      ofs -= req->seg_cnt;
+      req = req->merged;
+    }
+  if (run != NULL)
+    *run = req->seg_cnt - ofs;
+  return (uint8_t *) req->buffer + ofs * BLOCK_SECTOR_SIZE;
+}
+
+/* Called by a driver when it has finished carrying out REQ.
+   Starts the device's next request, then notifies the submitters
+   of REQ and of each request merged into it. */
+void
+block_complete (struct block_request *req)
+{
+  struct block *block = req->block;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  ASSERT (block->busy);
+  block->busy = false;
+  dispatch (block);
+  while (req != NULL)
+    {
+      /* Once notified, REQ may be reused at once. */
+      struct block_request *next = req->merged;
+      account_completion (req);
+      if (req->done != NULL)
+        req->done (req);
+      else
+        sema_up (&req->finished);
+      req = next;
+    }
+  intr_set_level (old_level);
+}
+
+/* Passes the request at the head of BLOCK's queue to its driver,
+   unless the driver is busy with another one.  Interrupts must be
+   off. */
+static void
+dispatch (struct block *block)
+{
+  struct block_request *req;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (block->busy || iosched_empty (&block->queue))
+    return;
+
+  req = iosched_next (&block->queue);
+  if (req->sector == block->last_end)
+    block->stats.sequential++;
+  else
+    block->stats.random++;
+  block->last_end = req->sector + req->cnt;
+  block->busy = true;
+  block->ops->start (block->aux, req);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +352,27 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns the sector, on the device that carries out BLOCK's
+   requests, that BLOCK's sector 0 maps to: 0 for a whole disk, or
+   the first sector of a partition.  Lets a file system align its
+   allocations to the disk rather than just to the partition. */
+block_sector_t
+block_base_sector (struct block *block)
+{
+  block_sector_t sector = 0;
+
+  while (block->ops->remap != NULL)
+    block = block->ops->remap (block->aux, &sector);
+  return sector;
+}
+
+/* Prints statistics for each block device used for a Pintos role,
+   then scheduler statistics for each device that has started
+   requests. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -173,9 +382,68 @@ block_print_stats (void)
         {
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->stats.read_cnt, block->stats.write_cnt);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->queue.started > 0)
+        {
+          const struct blkstat *s = &block->stats;
+          unsigned long long avg10 = s->depth_sum * 10 / s->depth_samples;
+
+          iosched_print_stats (&block->queue, block->name);
+          printf ("%s: %llu sequential, %llu random; "
+                  "queue depth %llu.%llu average, %u maximum\n",
+                  block->name, s->sequential, s->random,
+                  avg10 / 10, avg10 % 10, s->depth_max);
+          print_latency (s);
+        }
+    }
+}
+
+/* Copies BLOCK's statistics into STATS. */
+void
+block_get_stats (struct block *block, struct blkstat *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats = block->stats;
+  intr_set_level (old_level);
+}
+
+/* Adds REQ, which has just completed, to its device's latency
+   histogram. */
+static void
+account_completion (struct block_request *req)
+{
+  struct block *block = req->block;
+  uint64_t cycles = read_tsc () - req->submitted;
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < BLKSTAT_BUCKETS - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  block->stats.latency[bucket]++;
+  block->in_flight--;
+}
+
+/* Prints the non-empty buckets of the latency histogram in
+   STATS. */
+static void
+print_latency (const struct blkstat *stats)
+{
+  int i;
+
+  printf ("  latency (cycles):");
+  for (i = 0; i < BLKSTAT_BUCKETS; i++)
+    if (stats->latency[i] > 0)
+      printf (" 2^%d:%llu", i, stats->latency[i]);
+  printf ("\n");
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -198,8 +466,11 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  iosched_init (&block->queue);
+  block->busy = false;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->in_flight = 0;
+  block->last_end = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
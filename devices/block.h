@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <blkstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,22 +57,85 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_range (struct block *, block_sector_t, block_sector_t cnt,
+                       void *);
+void block_write_range (struct block *, block_sector_t, block_sector_t cnt,
+                        const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+block_sector_t block_base_sector (struct block *);
+
+/* Asynchronous requests. */
+
+struct block_request;
+
+/* Called when a block request completes, from an interrupt
+   handler or with interrupts disabled.  Must not sleep. */
+typedef void block_done_func (struct block_request *);
+
+/* A request to transfer CNT consecutive sectors between a block
+   device and memory.  BUFFER must be in kernel memory, because
+   the transfer may happen while another process is running.
+
+   While it waits in a device's queue, a request may absorb later
+   requests for the sectors that follow it, in the same direction.
+   Their buffers are chained through MERGED, and CNT grows to cover
+   them; drivers find each sector's memory with
+   block_request_buffer(). */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in device's queue. */
+    struct list_elem fifo_elem;         /* Element in scheduler's FIFO. */
+    struct block *block;                /* Device. */
+    bool write;                         /* Write (true) or read (false)? */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors, including
+                                           merged requests. */
+    void *buffer;                       /* SEG_CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_sector_t seg_cnt;             /* Sectors in BUFFER. */
+    struct block_request *merged;       /* Next merged request, or null. */
+    int64_t deadline;                   /* When it should be started, in
+                                           timer ticks. */
+    uint64_t submitted;                 /* CPU cycle count at submission. */
+    block_done_func *done;              /* Completion callback, or null. */
+    void *aux;                          /* For DONE's use. */
+    struct semaphore finished;          /* Up'd on completion if no DONE. */
+  };
+
+void block_request_init (struct block_request *, struct block *, bool write,
+                         block_sector_t sector, block_sector_t cnt,
+                         void *buffer, block_done_func *, void *aux);
+void block_submit (struct block_request *);
+void block_wait (struct block_request *);
+void *block_request_buffer (const struct block_request *, block_sector_t ofs,
+                            block_sector_t *run);
 
 /* Statistics. */
+void block_get_stats (struct block *, struct blkstat *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
 struct block_operations
   {
-    void (*read) (void *aux, block_sector_t, void *buffer);
-    void (*write) (void *aux, block_sector_t, const void *buffer);
+    /* Starts carrying out a request for any number of consecutive
+       sectors, which the driver must finish by calling
+       block_complete(), possibly before it returns.  Called with
+       interrupts disabled, possibly from an interrupt handler, so
+       it must not sleep.  The block layer passes a device at most
+       one request at a time. */
+    void (*start) (void *aux, struct block_request *);
+
+    /* If non-null, the device is a window onto another one, such
+       as a partition.  Requests are not started but passed on to
+       the device that this returns, after it translates *SECTOR
+       to that device's numbering. */
+    struct block *(*remap) (void *aux, block_sector_t *sector);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_complete (struct block_request *);
 
 #endif /* devices/block.h */
@@ -5,13 +5,18 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If the
+   controller is a PCI bus master IDE controller, as QEMU's and
+   most real PIIX chipsets are, disks that support it transfer
+   data by DMA [IDE-BM]; otherwise, by PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +35,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BMS_ERROR 0x02          /* Transfer failed (write 1 to clear). */
+#define BMS_INTR 0x04           /* Disk interrupted (write 1 to clear). */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +69,33 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors one command can transfer.  A sector count of 0 in
+   the Sector Count register means this many. */
+#define MAX_CMD_SECTORS 256
+
+/* Physical region descriptor: one physically contiguous piece of
+   memory in a DMA transfer, which must not cross a 64 kB
+   boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last descriptor. */
+  };
+
+/* PRD flags. */
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Number of PRDs per channel.  A command moves at most
+   MAX_CMD_SECTORS sectors, but they may be scattered across the
+   buffers of many merged requests. */
+#define PRD_CNT 32
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +104,16 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, or 0 if not in use. */
+    bool dma;                   /* Transfer data by DMA when possible? */
+
+    struct block_request *req;  /* Request from the block layer, or null. */
+    block_sector_t xfer_cnt;    /* Sectors of REQ transferred so far. */
+    block_sector_t cmd_left;    /* Sectors left in the current command. */
+    block_sector_t blk_cnt;     /* Sectors in the data block that the
+                                   current interrupt is for. */
+    bool cmd_dma;               /* Is the current command a DMA one? */
   };
 
 /* An ATA channel (aka controller).
@@ -66,11 +123,23 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, or 0 if the
+                                   channel cannot do DMA. */
+
+    /* PRD table for DMA.  Its alignment keeps it from crossing a
+       64 kB boundary, as the controller requires. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (sizeof (struct prd)
+                                                       * PRD_CNT)));
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct ata_disk *active;    /* Disk whose request is being carried
+                                   out, or null. */
+    struct intr_deferred completion;    /* Carries on with ACTIVE's
+                                           request after an interrupt. */
+    struct intr_deferred first_block;   /* Sends the first data block
+                                           of ACTIVE's PIO write. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -81,26 +150,44 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, const char *id);
 
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
+static void issue_ata_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
+static block_sector_t build_prdt (struct channel *,
+                                  const struct block_request *,
+                                  block_sector_t first, block_sector_t cnt);
+static void start_dma (struct ata_disk *, uint8_t command);
+
+static void start_transfer (struct ata_disk *);
+static void issue_command (struct ata_disk *);
+static block_sector_t next_block_cnt (const struct ata_disk *);
+static void transfer_block (struct ata_disk *);
+static void finish_block (struct ata_disk *);
+
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool poll_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static void channel_completion (void *c);
+static void channel_first_block (void *c);
 
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +210,12 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      intr_deferred_init (&c->completion, channel_completion, c);
+      intr_deferred_init (&c->first_block, channel_first_block, c);
+      c->active = NULL;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +226,11 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->req = NULL;
+          d->xfer_cnt = d->cmd_left = d->blk_cnt = 0;
+          d->cmd_dma = false;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +252,35 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* Looks for a PCI bus master IDE controller that drives the legacy
+   channels at their fixed ports and returns its bus master base
+   I/O port, after enabling bus mastering.  Returns 0 if there is
+   none, in which case all transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_address pci;
+  uint32_t class_reg, bar4, command;
+  uint8_t prog_if;
+
+  if (!pci_find_class (0x01, 0x01, &pci))
+    return 0;
+
+  /* Prog-if bit 7 says that bus mastering is supported; bits 0 and
+     2 would say that a channel has been moved off its legacy
+     ports.  Base address register 4 must be in I/O space. */
+  class_reg = pci_read_config (pci, PCI_REG_CLASS);
+  prog_if = class_reg >> 8;
+  bar4 = pci_read_config (pci, PCI_REG_BAR0 + 4 * 4);
+  if (!(prog_if & 0x80) || (prog_if & 0x05) || !(bar4 & 1))
+    return 0;
+
+  command = pci_read_config (pci, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (pci, PCI_REG_COMMAND,
+                    command | PCI_CMD_IO | PCI_CMD_MASTER);
+  return bar4 & 0xfffc;
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -270,9 +394,11 @@ identify_ata_device (struct ata_disk *d)
 
   /* Send the IDENTIFY DEVICE command, wait for an interrupt
      indicating the device's response is ready, and read the data
-     into our buffer. */
+     into our buffer.  Interrupts must be enabled or our semaphore
+     will never be up'd by the completion handler. */
+  ASSERT (intr_get_level () == INTR_ON);
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_ata_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -281,13 +407,19 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
+  set_multiple_mode (d, id);
+
+  /* Word 49, bit 8 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
+
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s", model, serial,
+            d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -309,6 +441,27 @@ identify_ata_device (struct ata_disk *d)
   partition_scan (block);
 }
 
+/* If the IDENTIFY DEVICE response ID says that disk D supports
+   READ/WRITE MULTIPLE, sets it to transfer as many sectors per
+   interrupt as it can, so that those commands may be used. */
+static void
+set_multiple_mode (struct ata_disk *d, const char *id)
+{
+  struct channel *c = d->channel;
+  int max = *(uint16_t *) &id[47 * 2] & 0xff;
+
+  if (max <= 1)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max);
+  issue_ata_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_alt_status (c)) & STA_ERR))
+    d->multiple = max;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +490,277 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Starts carrying out block request REQ on disk D, or, if the
+   other disk on D's channel is busy, arranges for it to start
+   when that disk's request completes.  Called by the block layer
+   with interrupts disabled. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_start (void *d_, struct block_request *req)
 {
   struct ata_disk *d = d_;
+
+  ASSERT (d->req == NULL);
+  d->req = req;
+  d->xfer_cnt = d->cmd_left = d->blk_cnt = 0;
+  if (d->channel->active == NULL)
+    start_transfer (d);
+}
+
+static struct block_operations ide_operations =
+  {
+    ide_start,
+    NULL
+  };
+
+/* Makes disk D's request the one in progress on its channel and
+   issues its first command. */
+static void
+start_transfer (struct ata_disk *d)
+{
+  d->channel->active = d;
+  issue_command (d);
+}
+
+/* Issues a command that transfers as many of the remaining
+   sectors of disk D's request as one command can.  The disk
+   interrupts once for each data block: a single sector, or up to
+   D->multiple sectors if D is in multiple mode. */
+static void
+issue_command (struct ata_disk *d)
+{
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_request *req = d->req;
+  block_sector_t left = req->cnt - d->xfer_cnt;
+  uint8_t command;
+
+  d->cmd_left = left < MAX_CMD_SECTORS ? left : MAX_CMD_SECTORS;
+
+  /* A DMA command interrupts only once, at the end.  It may cover
+     fewer sectors, if they do not all fit in the PRD table. */
+  d->cmd_dma = false;
+  if (d->dma)
+    {
+      block_sector_t cnt = build_prdt (c, req, d->xfer_cnt, d->cmd_left);
+      if (cnt > 0)
+        {
+          d->cmd_left = cnt;
+          d->cmd_dma = true;
+        }
+    }
+  if (d->cmd_dma)
+    {
+      d->blk_cnt = d->cmd_left;
+      start_dma (d, req->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      return;
+    }
+
+  select_sector (d, req->sector + d->xfer_cnt, d->cmd_left);
+  if (d->multiple > 0)
+    command = req->write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = req->write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+  issue_ata_command (c, command);
+
+  /* For a write, the disk interrupts once it has taken each data
+     block, so the first one has to be sent without waiting for an
+     interrupt.  Waiting for the disk and moving the data takes a
+     while, so it is done as deferred work, with interrupts on,
+     rather than here, where they may be off. */
+  if (req->write)
+    {
+      enum intr_level old_level = intr_disable ();
+      intr_defer (&c->first_block);
+      intr_set_level (old_level);
+    }
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Returns the number of sectors in the next data block of disk
+   D's current command. */
+static block_sector_t
+next_block_cnt (const struct ata_disk *d)
+{
+  if (d->multiple == 0)
+    return 1;
+  return (d->cmd_left < (block_sector_t) d->multiple
+          ? d->cmd_left : (block_sector_t) d->multiple);
+}
+
+/* Moves the next data block of disk D's current command through
+   the data register, once the disk is ready for it. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+transfer_block (struct ata_disk *d)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_request *req = d->req;
+  block_sector_t i;
+
+  d->blk_cnt = next_block_cnt (d);
+
+  if (!poll_while_busy (d))
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           req->write ? "write" : "read", req->sector + d->xfer_cnt);
+  for (i = 0; i < d->blk_cnt; i++)
+    {
+      void *buffer = block_request_buffer (req, d->xfer_cnt + i, NULL);
+      if (req->write)
+        output_sector (c, buffer);
+      else
+        input_sector (c, buffer);
+    }
+}
+
+/* Handles the interrupt that the disk D raises for each data
+   block.  Reads the block, for a read, then sends the next block
+   of the command, for a write, or issues the next command, or, at
+   the end of the request, completes it and gives the channel to
+   the other disk's request, if any.
+
+   Runs as deferred work, with interrupts on.  Until the request
+   completes, D is the channel's active disk, so nothing else
+   touches the channel's registers, but the disk may interrupt
+   again as soon as it is given something to do, so we must be
+   ready for that interrupt before doing so. */
+static void
+finish_block (struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  struct block_request *req = d->req;
+  struct ata_disk *other;
+  enum intr_level old_level;
+
+  if (d->cmd_dma)
+    {
+      uint8_t bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_command (c), 0);
+      outb (reg_bm_status (c), BMS_ERROR | BMS_INTR);
+      if ((bm_status & BMS_ERROR) || (inb (reg_alt_status (c)) & STA_ERR))
+        PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu, d->name,
+               req->write ? "write" : "read", req->sector + d->xfer_cnt);
+    }
+  else if (!req->write)
+    {
+      /* Once this block is drained, the disk reads the command's
+         next block, if any, and interrupts again. */
+      if (d->cmd_left > next_block_cnt (d))
+        c->expecting_interrupt = true;
+      transfer_block (d);
+    }
+  d->xfer_cnt += d->blk_cnt;
+  d->cmd_left -= d->blk_cnt;
+
+  if (d->cmd_left > 0)
+    {
+      /* Writes: the disk waits for us to send the next block. */
+      if (req->write)
+        {
+          c->expecting_interrupt = true;
+          transfer_block (d);
+        }
+      return;
+    }
+  if (d->xfer_cnt < req->cnt)
+    {
+      issue_command (d);
+      return;
+    }
+
+  /* The block layer may start either disk's next request at any
+     time once the channel is free. */
+  old_level = intr_disable ();
+  d->req = NULL;
+  c->active = NULL;
+  other = &c->devices[1 - d->dev_no];
+  if (other->req != NULL)
+    start_transfer (other);
+  block_complete (req);
+  intr_set_level (old_level);
+}
+
+/* Fills channel C's PRD table to describe the memory for the CNT
+   sectors of REQ starting at sector FIRST, or as many of them as
+   fit, and returns the number described.  Stops early, possibly
+   returning 0 so that PIO must be used instead, at memory that is
+   not a suitable DMA target: it must be in kernel memory, where
+   virtual and physical addresses correspond, and start on an even
+   address. */
+static block_sector_t
+build_prdt (struct channel *c, const struct block_request *req,
+            block_sector_t first, block_sector_t cnt)
+{
+  block_sector_t done = 0;
+  size_t i = 0;
+
+  while (done < cnt)
+    {
+      block_sector_t run;
+      const uint8_t *buffer = block_request_buffer (req, first + done, &run);
+      uintptr_t phys;
+      size_t size, pieces;
+
+      if (!is_kernel_vaddr (buffer) || ((uintptr_t) buffer & 1) != 0)
+        break;
+      if (run > cnt - done)
+        run = cnt - done;
+
+      /* The segment takes one PRD per 64 kB region it touches. */
+      phys = vtop (buffer);
+      size = run * BLOCK_SECTOR_SIZE;
+      pieces = ((phys + size - 1) >> 16) - (phys >> 16) + 1;
+      if (i + pieces > PRD_CNT)
+        break;
+      while (size > 0)
+        {
+          size_t n = 0x10000 - (phys & 0xffff);
+          if (n > size)
+            n = size;
+          c->prdt[i].addr = phys;
+          c->prdt[i].size = n & 0xffff;
+          c->prdt[i].flags = 0;
+          phys += n;
+          size -= n;
+          i++;
+        }
+      done += run;
+    }
+  if (i > 0)
+    c->prdt[i - 1].flags = PRD_EOT;
+  return done;
+}
+
+/* Starts a DMA transfer of the current command's sectors of disk
+   D's request, as described by its channel's PRD table, using
+   COMMAND. */
+static void
+start_dma (struct ata_disk *d, uint8_t command)
+{
+  struct channel *c = d->channel;
+  struct block_request *req = d->req;
+  uint8_t direction = req->write ? 0 : BMC_READ;
+
+  outb (reg_bm_command (c), 0);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), BMS_ERROR | BMS_INTR);
+  outb (reg_bm_command (c), direction);
+
+  select_sector (d, req->sector + d->xfer_cnt, d->cmd_left);
+  issue_ata_command (c, command);
+  outb (reg_bm_command (c), direction | BMC_START);
 }
 
-static struct block_operations ide_operations =
-  {
-    ide_read,
-    ide_write
-  };
-
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_CMD_SECTORS, to the disk's sector selection registers.  (We
    use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_CMD_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_CMD_SECTORS);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -404,12 +771,8 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_ata_command (struct channel *c, uint8_t command) 
 {
-  /* Interrupts must be enabled or our semaphore will never be
-     up'd by the completion handler. */
-  ASSERT (intr_get_level () == INTR_ON);
-
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
 }
@@ -446,7 +809,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +842,27 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Busy-waits up to 1 second for disk D to clear BSY, and then
+   returns the status of the DRQ bit.  Unlike wait_while_busy(),
+   does not sleep, so it may be used in an interrupt handler. */
+static bool
+poll_while_busy (const struct ata_disk *d) 
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+
+  printf ("%s: busy timeout\n", d->name);
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +873,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -513,8 +897,12 @@ interrupt_handler (struct intr_frame *f)
       {
         if (c->expecting_interrupt) 
           {
+            c->expecting_interrupt = false;
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            if (c->active != NULL)
+              intr_defer (&c->completion);      /* Continue request. */
+            else
+              sema_up (&c->completion_wait);    /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
@@ -524,4 +912,24 @@ interrupt_handler (struct intr_frame *f)
   NOT_REACHED ();
 }
 
+/* Deferred work for a PIO write starting on channel C_: sends the
+   first data block of the command just issued. */
+static void
+channel_first_block (void *c_)
+{
+  struct channel *c = c_;
+
+  ASSERT (c->active != NULL);
+  transfer_block (c->active);
+}
 
+/* Deferred work for channel C_'s interrupt: carries on with the
+   request in progress. */
+static void
+channel_completion (void *c_)
+{
+  struct channel *c = c_;
+
+  ASSERT (c->active != NULL);
+  finish_block (c->active);
+}
@@ -0,0 +1,285 @@
+#include "devices/iosched.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* I/O schedulers choose the order in which a block device's
+   queued requests start.
+
+   noop starts requests in the order they arrive.
+
+   clook (C-LOOK elevator) sweeps the disk in increasing sector
+   order, starting each time with the first request at or past the
+   end of the last one started, and jumps back to the lowest
+   queued request when none remains ahead.
+
+   deadline serves reads and writes in separate batches of up to
+   FIFO_BATCH requests in sector order, as clook does, preferring
+   reads, which someone is usually waiting for, but serving writes
+   after WRITES_STARVED read batches in a row.  A batch starts with
+   the oldest request of its direction if that request has waited
+   past its deadline.
+
+   All of them merge a request into a queued one for the
+   neighboring sectors in the same direction, so that the driver
+   can move both with one command.
+
+   All functions here must be called with interrupts off. */
+
+/* Deadline scheduler parameters. */
+#define READ_EXPIRE (TIMER_FREQ / 2)    /* Reads expire after 500 ms. */
+#define WRITE_EXPIRE (TIMER_FREQ * 5)   /* Writes expire after 5 s. */
+#define FIFO_BATCH 16                   /* Requests per batch. */
+#define WRITES_STARVED 2                /* Read batches before writes. */
+
+/* Largest request, in sectors, that merging may produce. */
+#define MERGE_MAX 128
+
+/* An I/O scheduler. */
+struct iosched
+  {
+    const char *name;                   /* Name for -iosched option. */
+    bool sorted;                        /* Keep REQS in sector order? */
+    bool fifos;                         /* Keep FIFO lists? */
+    struct block_request *(*next) (struct iosched_queue *);
+  };
+
+static struct block_request *noop_next (struct iosched_queue *);
+static struct block_request *clook_next (struct iosched_queue *);
+static struct block_request *deadline_next (struct iosched_queue *);
+
+static const struct iosched schedulers[] =
+  {
+    {"noop", false, false, noop_next},
+    {"clook", true, false, clook_next},
+    {"deadline", true, true, deadline_next},
+  };
+#define SCHEDULER_CNT (sizeof schedulers / sizeof *schedulers)
+
+/* Scheduler for devices registered from now on. */
+static const struct iosched *default_sched = &schedulers[2];
+
+/* Makes the scheduler called NAME the one used by block devices
+   registered from now on.  Returns false if there is no such
+   scheduler. */
+bool
+iosched_select (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < SCHEDULER_CNT; i++)
+    if (!strcmp (name, schedulers[i].name))
+      {
+        default_sched = &schedulers[i];
+        return true;
+      }
+  return false;
+}
+
+/* Initializes Q as an empty queue using the current scheduler. */
+void
+iosched_init (struct iosched_queue *q)
+{
+  q->sched = default_sched;
+  list_init (&q->reqs);
+  list_init (&q->fifo[0]);
+  list_init (&q->fifo[1]);
+  q->cnt = 0;
+  q->head = 0;
+  q->write = false;
+  q->batch_left = 0;
+  q->starved = 0;
+  q->started = q->merges = q->expired = 0;
+}
+
+/* Returns true if A's first sector precedes B's. */
+static bool
+sector_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return (list_entry (a, struct block_request, elem)->sector
+          < list_entry (b, struct block_request, elem)->sector);
+}
+
+/* Tries to merge REQ into a queued request in Q for the sectors
+   just before or after REQ's.  Returns true if successful. */
+static bool
+try_merge (struct iosched_queue *q, struct block_request *req)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&q->reqs); e != list_end (&q->reqs); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+
+      if (r->write != req->write || r->cnt + req->cnt > MERGE_MAX)
+        continue;
+      if (r->sector + r->cnt == req->sector)
+        {
+          /* Back merge: REQ joins the end of R's chain. */
+          struct block_request *tail = r;
+          while (tail->merged != NULL)
+            tail = tail->merged;
+          tail->merged = req;
+          r->cnt += req->cnt;
+          return true;
+        }
+      if (req->sector + req->cnt == r->sector)
+        {
+          /* Front merge: REQ takes R's place, with R's chain
+             behind it. */
+          req->merged = r;
+          req->cnt += r->cnt;
+          req->deadline = r->deadline;
+          list_insert (&r->elem, &req->elem);
+          list_remove (&r->elem);
+          if (q->sched->fifos)
+            {
+              list_insert (&r->fifo_elem, &req->fifo_elem);
+              list_remove (&r->fifo_elem);
+            }
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Adds REQ to Q. */
+void
+iosched_add (struct iosched_queue *q, struct block_request *req)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  req->deadline = timer_ticks () + (req->write ? WRITE_EXPIRE : READ_EXPIRE);
+  if (try_merge (q, req))
+    {
+      q->merges++;
+      return;
+    }
+
+  if (q->sched->sorted)
+    list_insert_ordered (&q->reqs, &req->elem, sector_less, NULL);
+  else
+    list_push_back (&q->reqs, &req->elem);
+  if (q->sched->fifos)
+    list_push_back (&q->fifo[req->write], &req->fifo_elem);
+  q->cnt++;
+}
+
+/* Removes and returns the request in Q that should start next.
+   Q must not be empty. */
+struct block_request *
+iosched_next (struct iosched_queue *q)
+{
+  struct block_request *req;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!iosched_empty (q));
+
+  req = q->sched->next (q);
+  list_remove (&req->elem);
+  if (q->sched->fifos)
+    list_remove (&req->fifo_elem);
+  q->cnt--;
+  q->head = req->sector + req->cnt;
+  q->started++;
+  return req;
+}
+
+/* Returns true if Q has no requests. */
+bool
+iosched_empty (const struct iosched_queue *q)
+{
+  return q->cnt == 0;
+}
+
+/* Prints statistics for Q, the queue of the device called NAME. */
+void
+iosched_print_stats (const struct iosched_queue *q, const char *name)
+{
+  printf ("%s: %s scheduler: %llu requests started, %llu merged",
+          name, q->sched->name, q->started, q->merges);
+  if (q->sched->fifos)
+    printf (", %llu expired", q->expired);
+  printf ("\n");
+}
+
+/* Returns the first request in Q, which must be in sector order,
+   whose first sector is POS or later and whose direction is
+   WRITE, or any direction if ANY_DIR.  If there is none and WRAP,
+   returns the first request in that direction from the start of
+   Q instead.  Returns a null pointer if there is no such request. */
+static struct block_request *
+first_from (struct iosched_queue *q, block_sector_t pos, bool any_dir,
+            bool write, bool wrap)
+{
+  struct block_request *first = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&q->reqs); e != list_end (&q->reqs); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (!any_dir && r->write != write)
+        continue;
+      if (r->sector >= pos)
+        return r;
+      if (first == NULL)
+        first = r;
+    }
+  return wrap ? first : NULL;
+}
+
+/* noop: the oldest request. */
+static struct block_request *
+noop_next (struct iosched_queue *q)
+{
+  return list_entry (list_front (&q->reqs), struct block_request, elem);
+}
+
+/* clook: the next request in the sweep. */
+static struct block_request *
+clook_next (struct iosched_queue *q)
+{
+  return first_from (q, q->head, true, false, true);
+}
+
+/* deadline: the next request of the current batch, or the first
+   of a new one. */
+static struct block_request *
+deadline_next (struct iosched_queue *q)
+{
+  struct block_request *req = NULL;
+
+  if (q->batch_left > 0)
+    req = first_from (q, q->head, false, q->write, false);
+  if (req == NULL)
+    {
+      bool reads = !list_empty (&q->fifo[false]);
+      bool writes = !list_empty (&q->fifo[true]);
+      struct block_request *oldest;
+
+      /* Choose a direction. */
+      q->write = !reads || (writes && q->starved >= WRITES_STARVED);
+      if (q->write)
+        q->starved = 0;
+      else if (writes)
+        q->starved++;
+
+      /* Start with the oldest request if it has expired,
+         otherwise continue the sweep. */
+      oldest = list_entry (list_front (&q->fifo[q->write]),
+                           struct block_request, fifo_elem);
+      if (timer_ticks () >= oldest->deadline)
+        {
+          req = oldest;
+          q->expired++;
+        }
+      else
+        req = first_from (q, q->head, false, q->write, true);
+      q->batch_left = FIFO_BATCH;
+    }
+  q->batch_left--;
+  return req;
+}
@@ -0,0 +1,43 @@
+#ifndef DEVICES_IOSCHED_H
+#define DEVICES_IOSCHED_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+struct iosched;
+
+/* A block device's requests that are waiting to start, kept in
+   the order that the device's I/O scheduler wants. */
+struct iosched_queue
+  {
+    const struct iosched *sched;        /* Scheduler. */
+    struct list reqs;                   /* Requests, in arrival order for
+                                           noop, otherwise sector order. */
+    struct list fifo[2];                /* Deadline: reads and writes, each
+                                           in arrival order. */
+    size_t cnt;                         /* Number of requests. */
+    block_sector_t head;                /* Sector just past the end of the
+                                           last request started. */
+    bool write;                         /* Deadline: direction of batch. */
+    int batch_left;                     /* Deadline: requests left in the
+                                           current batch. */
+    int starved;                        /* Deadline: batches of reads since
+                                           writes were last served. */
+
+    /* Statistics. */
+    unsigned long long started;         /* Requests started. */
+    unsigned long long merges;          /* Requests merged into others. */
+    unsigned long long expired;         /* Requests started because their
+                                           deadlines passed. */
+  };
+
+bool iosched_select (const char *name);
+void iosched_init (struct iosched_queue *);
+void iosched_add (struct iosched_queue *, struct block_request *);
+struct block_request *iosched_next (struct iosched_queue *);
+bool iosched_empty (const struct iosched_queue *);
+void iosched_print_stats (const struct iosched_queue *, const char *name);
+
+#endif /* devices/iosched.h */
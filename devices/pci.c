@@ -0,0 +1,89 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* This code reads and writes PCI configuration space through
+   configuration mechanism #1, which every PCI chipset that Pintos
+   runs on supports.  See [PCI] for details. */
+
+/* I/O ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8        /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc           /* Reads or writes it. */
+
+/* Selects configuration register REG of the function at ADDR, so
+   that it may be accessed through PCI_CONFIG_DATA. */
+static void
+select_register (struct pci_address addr, uint8_t reg)
+{
+  ASSERT (addr.dev < 32 && addr.func < 8);
+  outl (PCI_CONFIG_ADDRESS, (0x80000000 | (addr.bus << 16) | (addr.dev << 11)
+                             | (addr.func << 8) | (reg & 0xfc)));
+}
+
+/* Returns the 32-bit configuration register REG, which must be a
+   multiple of 4, of the function at ADDR. */
+uint32_t
+pci_read_config (struct pci_address addr, uint8_t reg)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t value;
+
+  select_register (addr, reg);
+  value = inl (PCI_CONFIG_DATA);
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Sets the 32-bit configuration register REG, which must be a
+   multiple of 4, of the function at ADDR to VALUE. */
+void
+pci_write_config (struct pci_address addr, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level = intr_disable ();
+
+  select_register (addr, reg);
+  outl (PCI_CONFIG_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Searches bus 0, where the chipset's own functions live, for the
+   first function with the given CLASS and SUBCLASS.  If one is
+   found, stores its address in *ADDR and returns true. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *addr)
+{
+  struct pci_address a;
+  int dev, func;
+
+  a.bus = 0;
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class_reg;
+
+        a.dev = dev;
+        a.func = func;
+        if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == 0xffff)
+          {
+            /* No such function. */
+            if (func == 0)
+              break;
+            continue;
+          }
+
+        class_reg = pci_read_config (a, PCI_REG_CLASS);
+        if ((class_reg >> 24) == class
+            && ((class_reg >> 16) & 0xff) == subclass)
+          {
+            *addr = a;
+            return true;
+          }
+
+        /* Only multi-function devices have functions past 0. */
+        if (func == 0
+            && !(pci_read_config (a, PCI_REG_HEADER) & 0x00800000))
+          break;
+      }
+  return false;
+}
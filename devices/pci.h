@@ -0,0 +1,30 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function. */
+struct pci_address
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Offsets of registers in PCI configuration space. */
+#define PCI_REG_ID 0x00         /* Vendor ID (15:0), device ID (31:16). */
+#define PCI_REG_COMMAND 0x04    /* Command (15:0), status (31:16). */
+#define PCI_REG_CLASS 0x08      /* Revision, prog-if, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 23:16. */
+#define PCI_REG_BAR0 0x10       /* First of six base address registers. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as bus master. */
+
+uint32_t pci_read_config (struct pci_address, uint8_t reg);
+void pci_write_config (struct pci_address, uint8_t reg, uint32_t value);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *);
+
+#endif /* devices/pci.h */
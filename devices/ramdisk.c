@@ -0,0 +1,88 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device held in kernel memory.
+
+   Its contents do not survive a reboot, but transfers cost only a
+   memcpy(), which makes it useful for measuring the software
+   overhead of the file system and as fast scratch space.  The
+   memory comes from the kernel pool one page at a time, so it
+   need not be contiguous. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    size_t page_cnt;            /* Number of pages. */
+    uint8_t **pages;            /* The pages themselves. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates block device "ram0", KB kilobytes in size (rounded up to
+   a whole number of pages).  Its initial contents are all
+   zeros. */
+void
+ramdisk_init (size_t kb)
+{
+  struct ramdisk *r;
+  char extra_info[128];
+  size_t i;
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    PANIC ("Failed to allocate memory for RAM disk");
+  r->page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  if (r->page_cnt == 0)
+    PANIC ("RAM disk must not be empty");
+  r->pages = malloc (r->page_cnt * sizeof *r->pages);
+  if (r->pages == NULL)
+    PANIC ("Failed to allocate memory for RAM disk");
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      r->pages[i] = palloc_get_page (PAL_ZERO);
+      if (r->pages[i] == NULL)
+        PANIC ("Out of kernel memory for %zu kB RAM disk", kb);
+    }
+
+  snprintf (extra_info, sizeof extra_info, "%zu pages of RAM", r->page_cnt);
+  block_register ("ram0", BLOCK_RAW, extra_info,
+                  r->page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, r);
+}
+
+/* Carries out REQ on RAM disk R, then completes it at once. */
+static void
+ramdisk_start (void *r_, struct block_request *req)
+{
+  struct ramdisk *r = r_;
+  block_sector_t ofs;
+
+  for (ofs = 0; ofs < req->cnt; ofs++)
+    {
+      block_sector_t sector = req->sector + ofs;
+      uint8_t *disk = (r->pages[sector / SECTORS_PER_PAGE]
+                       + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+      void *buffer = block_request_buffer (req, ofs, NULL);
+
+      if (req->write)
+        memcpy (disk, buffer, BLOCK_SECTOR_SIZE);
+      else
+        memcpy (buffer, disk, BLOCK_SECTOR_SIZE);
+    }
+  block_complete (req);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_start,
+    NULL
+  };
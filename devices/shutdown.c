@@ -10,6 +10,7 @@
 #include "userprog/exception.h"
 #endif
 #ifdef FILESYS
+#include "devices/blktrace.h"
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
@@ -92,6 +93,7 @@ shutdown_power_off (void)
 
 #ifdef FILESYS
   filesys_done ();
+  blktrace_dump ();
 #endif
 
   print_stats ();
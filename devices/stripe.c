@@ -0,0 +1,179 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* A striped (RAID-0) block device.
+
+   The device's sectors are dealt out to its members in chunks of
+   STRIPE_CHUNK sectors: chunk 0 goes to the first member, chunk 1
+   to the second, and so on, wrapping around after the last one.
+   A request that spans several chunks is split into one
+   sub-request per chunk, and the sub-requests are submitted to
+   the members all at once, so that members on different IDE
+   channels transfer at the same time.  Consecutive chunks bound
+   for the same member are adjacent on that member, so its
+   scheduler merges them back into a single transfer.
+
+   There is no redundancy: losing any member loses the device. */
+
+/* Sectors per chunk. */
+#define STRIPE_CHUNK 8
+
+/* Maximum number of members. */
+#define STRIPE_MAX 4
+
+/* Sub-requests in flight at once.  A request needing more is
+   carried out in several rounds. */
+#define STRIPE_SUBS 32
+
+/* A striped device. */
+struct stripe
+  {
+    struct block *members[STRIPE_MAX];  /* Member devices. */
+    int member_cnt;                     /* Number of members. */
+
+    /* Request in progress. */
+    struct block_request *req;          /* Request, or null if idle. */
+    block_sector_t next;                /* First sector not yet
+                                           submitted, relative to REQ. */
+    int pending;                        /* Sub-requests not yet done. */
+    struct block_request subs[STRIPE_SUBS];
+  };
+
+static struct block_operations stripe_operations;
+
+static void submit_round (struct stripe *);
+static void sub_done (struct block_request *);
+
+/* Creates block device "md0" by striping the comma-separated
+   list of block devices MEMBERS, e.g. "hdb,hdc".  For the
+   members to transfer in parallel, they should be on different
+   IDE channels. */
+void
+stripe_init (char *members)
+{
+  struct stripe *s;
+  block_sector_t member_size = 0;
+  char extra_info[128];
+  char *name, *save_ptr;
+  int i;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    PANIC ("Failed to allocate memory for striped device");
+  s->member_cnt = 0;
+  s->req = NULL;
+
+  for (name = strtok_r (members, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      if (s->member_cnt >= STRIPE_MAX)
+        PANIC ("Too many striped devices (maximum %d)", STRIPE_MAX);
+      for (i = 0; i < s->member_cnt; i++)
+        if (s->members[i] == block)
+          PANIC ("Block device \"%s\" striped twice", name);
+
+      if (s->member_cnt == 0 || block_size (block) < member_size)
+        member_size = block_size (block);
+      s->members[s->member_cnt++] = block;
+    }
+  if (s->member_cnt < 2)
+    PANIC ("Striping needs at least two block devices");
+
+  /* Each member contributes the same number of whole chunks. */
+  member_size -= member_size % STRIPE_CHUNK;
+
+  strlcpy (extra_info, "stripe of", sizeof extra_info);
+  for (i = 0; i < s->member_cnt; i++)
+    {
+      strlcat (extra_info, " ", sizeof extra_info);
+      strlcat (extra_info, block_name (s->members[i]), sizeof extra_info);
+    }
+  block_register ("md0", BLOCK_RAW, extra_info, member_size * s->member_cnt,
+                  &stripe_operations, s);
+}
+
+/* Starts carrying out REQ on the striped device S. */
+static void
+stripe_start (void *s_, struct block_request *req)
+{
+  struct stripe *s = s_;
+
+  ASSERT (s->req == NULL);
+  s->req = req;
+  s->next = 0;
+  submit_round (s);
+}
+
+/* Splits as much of S's request as will fit in S->subs into
+   sub-requests along chunk and buffer boundaries, and submits
+   them to the members. */
+static void
+submit_round (struct stripe *s)
+{
+  struct block_request *req = s->req;
+  int sub_cnt, i;
+
+  for (sub_cnt = 0; sub_cnt < STRIPE_SUBS && s->next < req->cnt; sub_cnt++)
+    {
+      block_sector_t sector = req->sector + s->next;
+      block_sector_t chunk = sector / STRIPE_CHUNK;
+      block_sector_t chunk_ofs = sector % STRIPE_CHUNK;
+      block_sector_t cnt = STRIPE_CHUNK - chunk_ofs;
+      block_sector_t run;
+      void *buffer;
+
+      if (cnt > req->cnt - s->next)
+        cnt = req->cnt - s->next;
+      buffer = block_request_buffer (req, s->next, &run);
+      if (cnt > run)
+        cnt = run;
+
+      block_request_init (&s->subs[sub_cnt],
+                          s->members[chunk % s->member_cnt], req->write,
+                          chunk / s->member_cnt * STRIPE_CHUNK + chunk_ofs,
+                          cnt, buffer, sub_done, s);
+      s->next += cnt;
+    }
+
+  /* Count them all before submitting any, since a member may
+     finish one before the next is submitted. */
+  s->pending = sub_cnt;
+  for (i = 0; i < sub_cnt; i++)
+    block_submit (&s->subs[i]);
+}
+
+/* Called when one of a striped device's sub-requests SUB
+   completes. */
+static void
+sub_done (struct block_request *sub)
+{
+  struct stripe *s = sub->aux;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (s->pending > 0);
+  if (--s->pending > 0)
+    return;
+
+  if (s->next < s->req->cnt)
+    submit_round (s);
+  else
+    {
+      struct block_request *req = s->req;
+      s->req = NULL;
+      block_complete (req);
+    }
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_start,
+    NULL
+  };
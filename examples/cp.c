@@ -25,7 +25,7 @@ main (int argc, char *argv[])
     }
 
   /* Create and open output file. */
-  if (!create (argv[2], filesize (in_fd))) 
+  if (!create (argv[2], 0)) 
     {
       printf ("%s: create failed\n", argv[2]);
       return EXIT_FAILURE;
@@ -37,14 +37,13 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Copy data. */
+  /* Copy data, within the kernel. */
   for (;;) 
     {
-      char buffer[1024];
-      int bytes_read = read (in_fd, buffer, sizeof buffer);
-      if (bytes_read == 0)
+      int size = filesize (in_fd) - tell (in_fd);
+      if (size <= 0)
         break;
-      if (write (out_fd, buffer, bytes_read) != bytes_read) 
+      if (copy_file_range (in_fd, out_fd, size) <= 0) 
         {
           printf ("%s: write failed\n", argv[2]);
           return EXIT_FAILURE;
@@ -37,23 +37,21 @@ list_dir (const char *dir, bool verbose)
           if (verbose) 
             {
               char full_name[128];
-              int entry_fd;
+              struct stat st;
 
               snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
 
               printf (": ");
-              if (entry_fd != -1)
+              if (stat (full_name, &st))
                 {
-                  if (isdir (entry_fd))
+                  if (st.isdir)
                     printf ("directory");
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    printf ("%d-byte file", st.size);
+                  printf (", inumber %d", st.inumber);
                 }
               else
-                printf ("open failed");
-              close (entry_fd);
+                printf ("stat failed");
             }
           printf ("\n");
         }
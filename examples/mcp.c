@@ -1,19 +1,16 @@
 /* mcp.c
 
-   Copies one file to another, using mmap. */
+   Copies one file to another without passing the data through
+   user memory, using copy_file_range. */
 
 #include <stdio.h>
-#include <string.h>
 #include <syscall.h>
 
 int
 main (int argc, char *argv[]) 
 {
   int in_fd, out_fd;
-  mapid_t in_map, out_map;
-  void *in_data = (void *) 0x10000000;
-  void *out_data = (void *) 0x20000000;
-  int size;
+  int size, copied;
 
   if (argc != 3) 
     {
@@ -31,7 +28,7 @@ main (int argc, char *argv[])
   size = filesize (in_fd);
 
   /* Create and open output file. */
-  if (!create (argv[2], size)) 
+  if (!create (argv[2], 0)) 
     {
       printf ("%s: create failed\n", argv[2]);
       return EXIT_FAILURE;
@@ -43,26 +40,17 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Map files. */
-  in_map = mmap (in_fd, in_data);
-  if (in_map == MAP_FAILED) 
-    {
-      printf ("%s: mmap failed\n", argv[1]);
-      return EXIT_FAILURE;
-    }
-  out_map = mmap (out_fd, out_data);
-  if (out_map == MAP_FAILED)
+  /* Copy files. */
+  for (copied = 0; copied < size; ) 
     {
-      printf ("%s: mmap failed\n", argv[2]);
-      return EXIT_FAILURE;
+      int bytes = copy_file_range (in_fd, out_fd, size - copied);
+      if (bytes <= 0)
+        {
+          printf ("%s: copy failed\n", argv[2]);
+          return EXIT_FAILURE;
+        }
+      copied += bytes;
     }
 
-  /* Copy files. */
-  memcpy (out_data, in_data, size);
-
-  /* Unmap files (optional). */
-  munmap (in_map);
-  munmap (out_map);
-
   return EXIT_SUCCESS;
 }
@@ -1,12 +1,25 @@
 #include "filesys/cache.h"
 #include <stdio.h>
 #include "filesys/filesys.h"
+#include <string.h>
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "userprog/syscall.h"
 
-int cache_has_empty (void);
-int cache_evict (void);
-void cache_read_disk (block_sector_t, int);
+/* Sectors queued for asynchronous prefetch, as a ring buffer. */
+static block_sector_t prefetch_queue[PREFETCH_QUEUE_SIZE];
+static size_t prefetch_head;            /* Index of oldest queued sector. */
+static size_t prefetch_cnt;             /* Number of queued sectors. */
+static struct lock prefetch_lock;       /* Protects the queue. */
+static struct condition prefetch_cond;  /* Signaled when a sector is queued. */
+
+static thread_func prefetch_thread;
+static int find_entry (block_sector_t);
+static int lookup (block_sector_t, const void *);
+
+int cache_has_empty (int);
+int cache_evict (int);
+void cache_read_disk (block_sector_t, int, const void *);
 void increment_users (int);
 void decrement_users (int);
 void cache_clear (int);
@@ -16,117 +29,410 @@ void
 cache_init ()
 {
   lock_init (&buffer_cache.lock);
+  cond_init (&buffer_cache.loaded);
 
   int i;
-  for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+  for (i = 0; i < VOLUME_MAX; i++)
+    buffer_cache.hand[i] = i * BUFFER_CACHE_SIZE;
+  for (i = 0; i < CACHE_ENTRY_CNT; i++)
     {
       buffer_cache.cache[i].valid = false;
       lock_init (&buffer_cache.cache[i].lock);
       buffer_cache.cache[i].users = 0;
+      buffer_cache.cache[i].journaled = false;
+      buffer_cache.cache[i].owner = CACHE_NO_OWNER;
+      buffer_cache.cache[i].loading = false;
+      buffer_cache.cache[i].evicting = false;
     }
 }
 
+/* Starts the thread that services cache_prefetch() requests.
+   Must be called after the thread system is running. */
+void
+cache_prefetch_init (void)
+{
+  lock_init (&prefetch_lock);
+  cond_init (&prefetch_cond);
+  prefetch_head = prefetch_cnt = 0;
+  thread_create ("prefetch", PRI_DEFAULT, prefetch_thread, NULL);
+}
+
+/* Returns the index of the first entry in the partition of the
+   buffer cache that holds sectors of SECTOR's volume. */
+static int
+partition_start (block_sector_t sector)
+{
+  return sector_volume (sector) * BUFFER_CACHE_SIZE;
+}
+
 /* Return the index to disk block sector SECTOR in the buffer cache.
    If SECTOR is not already in the buffer cache, reads the block sector
    from disk and writes it to the buffer cache. If there are no empty 
-   buffer cache entries, chooses an entry to evict and writes there.
+   buffer cache entries in SECTOR's partition, chooses an entry there
+   to evict and writes there.
 
    Caller must call cache_operation_done() when it is done with SECTOR. */
 int
 cache_lookup (block_sector_t sector)
 {
+  return lookup (sector, NULL);
+}
+
+/* Copies BLOCK_SECTOR_SIZE bytes from DATA into the buffer cache
+   entry for disk block sector SECTOR, which need not be read from
+   disk first, since all of it is overwritten, and returns the
+   entry's index as cache_lookup() does.  The caller marks the
+   entry dirty.
+
+   Caller must call cache_operation_done() when it is done with SECTOR. */
+int
+cache_overwrite (block_sector_t sector, const void *data)
+{
+  return lookup (sector, data);
+}
+
+/* Does the work of cache_lookup() and, if DATA is non-null, of
+   cache_overwrite(). */
+static int
+lookup (block_sector_t sector, const void *data)
+{
+  int first = partition_start (sector);
+
   lock_acquire (&buffer_cache.lock);
-  /* Look for SECTOR in buffer cache. */
   int i;
-  for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+  for (;;)
     {
-      if (buffer_cache.cache[i].valid
-          && buffer_cache.cache[i].sector == sector)
+      /* Look for SECTOR in buffer cache. */
+      i = find_entry (sector);
+      if (i != -1)
         {
-          increment_users (i);
           lock_release (&buffer_cache.lock);
+          if (data != NULL)
+            memcpy (buffer_cache.cache[i].data, data, BLOCK_SECTOR_SIZE);
           return i;
         }
-    }
 
-  /* Failing that, we need to read a sector from disk. */
-  i = cache_has_empty();
-  if (i == -1)
-    i = cache_evict ();
+      /* Failing that, we need to read a sector from disk. */
+      i = cache_has_empty (first);
+      if (i == -1)
+        i = cache_evict (first);
+      if (i != -1)
+        break;
+    }
 
-  cache_read_disk (sector, i);
+  cache_read_disk (sector, i, data);
   lock_release (&buffer_cache.lock);
 
   return i;
 }
 
-/* Returns index of first empty cache entry, else -1. This operation should
-   probably be called while holding the buffer cache lock.*/
+/* Returns the index of disk block sector SECTOR in the buffer cache,
+   as cache_lookup() does, if it is already there.  Returns -1,
+   without reading anything from disk, if it is not.
+
+   If the return value is not -1, the caller must call
+   cache_operation_done() when it is done with SECTOR. */
 int
-cache_has_empty ()
+cache_find (block_sector_t sector)
 {
   int i;
-  for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+
+  lock_acquire (&buffer_cache.lock);
+  i = find_entry (sector);
+  lock_release (&buffer_cache.lock);
+  return i;
+}
+
+/* Returns the index of the entry that holds SECTOR, with its user
+   count incremented, or -1 if SECTOR is not in the buffer cache.
+   If the entry is still being read in, waits until it has been.
+   If SECTOR's old contents are still being written back from an
+   entry that is being reused, waits for that and looks again.
+   Must be called with the buffer cache lock held, which is
+   released while waiting. */
+static int
+find_entry (block_sector_t sector)
+{
+  int first = partition_start (sector);
+  int i;
+
+  for (i = first; i < first + BUFFER_CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &buffer_cache.cache[i];
+
+      if (e->evicting && e->old_sector == sector)
+        {
+          cond_wait (&buffer_cache.loaded, &buffer_cache.lock);
+          i = first - 1;
+        }
+      else if (e->valid && e->sector == sector)
+        {
+          increment_users (i);
+          e->accessed = true;
+          while (e->loading)
+            cond_wait (&buffer_cache.loaded, &buffer_cache.lock);
+          return i;
+        }
+    }
+  return -1;
+}
+
+/* Copies disk block sector SECTOR into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes, by way of the buffer cache. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  int index = cache_lookup (sector);
+  memcpy (buffer, buffer_cache.cache[index].data, BLOCK_SECTOR_SIZE);
+  cache_operation_done (index);
+}
+
+/* Copies BLOCK_SECTOR_SIZE bytes from BUFFER into the buffer cache
+   entry for disk block sector SECTOR.  The sector reaches the disk
+   when it is evicted or the cache is flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  int index = cache_overwrite (sector, buffer);
+  buffer_cache.cache[index].dirty = true;
+  cache_operation_done (index);
+}
+
+/* Asks for SECTOR to be read into the buffer cache in the
+   background, so that a later cache_lookup() finds it without
+   waiting on the disk.  Does not block; the request is dropped if
+   the prefetch queue is full. */
+void
+cache_prefetch (block_sector_t sector)
+{
+  lock_acquire (&prefetch_lock);
+  if (prefetch_cnt < PREFETCH_QUEUE_SIZE)
+    {
+      prefetch_queue[(prefetch_head + prefetch_cnt) % PREFETCH_QUEUE_SIZE]
+        = sector;
+      prefetch_cnt++;
+      cond_signal (&prefetch_cond, &prefetch_lock);
+    }
+  lock_release (&prefetch_lock);
+}
+
+/* Returns true if SECTOR is in the buffer cache. */
+static bool
+cache_contains (block_sector_t sector)
+{
+  int first = partition_start (sector);
+  bool found = false;
+  int i;
+
+  lock_acquire (&buffer_cache.lock);
+  for (i = first; i < first + BUFFER_CACHE_SIZE && !found; i++)
+    found = (buffer_cache.cache[i].valid
+             && buffer_cache.cache[i].sector == sector);
+  lock_release (&buffer_cache.lock);
+
+  return found;
+}
+
+/* Reads queued sectors into the buffer cache, one at a time. */
+static void
+prefetch_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&prefetch_lock);
+      while (prefetch_cnt == 0)
+        cond_wait (&prefetch_cond, &prefetch_lock);
+      sector = prefetch_queue[prefetch_head];
+      prefetch_head = (prefetch_head + 1) % PREFETCH_QUEUE_SIZE;
+      prefetch_cnt--;
+      lock_release (&prefetch_lock);
+
+      if (!cache_contains (sector))
+        cache_operation_done (cache_lookup (sector));
+    }
+}
+
+/* Returns index of first empty cache entry in the partition that
+   starts at entry FIRST, else -1. This operation should probably be
+   called while holding the buffer cache lock.*/
+int
+cache_has_empty (int first)
+{
+  int i;
+  for (i = first; i < first + BUFFER_CACHE_SIZE; i++)
     if (buffer_cache.cache[i].valid == false)
       return i;
 
   return -1;
 }
 
-/* Evict an entry from the buffer cache, returning its index. This operation
-   can only be called while holding the buffer cache lock.
+/* Evict an entry from the partition of the buffer cache that starts
+   at entry FIRST, returning its index. This operation can only be
+   called while holding the buffer cache lock.  The entry still
+   holds its old sector, which cache_read_disk() writes back if it
+   is dirty.
 
-   This is a modification to the clock algorithm. A single hand sweeps once,
-   marking all sectors with no users as accessed. If after two sweeps through
-   the cache, no eviction candidates are found, sleep and try again. */
+   This is the clock algorithm.  The hand skips entries that are in use
+   or that the journal has pinned, and gives recently accessed entries a
+   second chance by clearing their accessed bits.  If two full sweeps
+   find no candidate, yields the buffer cache lock so that other threads
+   can finish with their entries, then returns -1: meanwhile another
+   thread may have read in the sector the caller wants. */
 int
-cache_evict ()
+cache_evict (int first)
 {
-  int start = buffer_cache.hand;
-  bool first = true;
+  int *hand = &buffer_cache.hand[first / BUFFER_CACHE_SIZE];
+  int checked = 0;
 
-  while (buffer_cache.cache[buffer_cache.hand].accessed && first == true)
+  for (;;)
     {
-      /* Skip the entry or mark it as not accessed. */
-      if (buffer_cache.cache[buffer_cache.hand].users > 0)
-        continue;
-      buffer_cache.cache[buffer_cache.hand].accessed = false;
+      struct cache_entry *e = &buffer_cache.cache[*hand];
+      int index = *hand;
 
       /* Increment clock hand. */
-      if (buffer_cache.hand == BUFFER_CACHE_SIZE - 1)
-        buffer_cache.hand = 0;
+      if (*hand == first + BUFFER_CACHE_SIZE - 1)
+        *hand = first;
       else
-        buffer_cache.hand++;
+        (*hand)++;
+
+      if (e->users == 0 && !e->journaled)
+        {
+          if (!e->accessed)
+            return index;
+          e->accessed = false;
+        }
+
+      if (++checked == 2 * BUFFER_CACHE_SIZE)
+        {
+          lock_release (&buffer_cache.lock);
+          thread_yield ();
+          lock_acquire (&buffer_cache.lock);
+          return -1;
+        }
+    }
+}
+
+/* Reads SECTOR from disk into the INDEX'th entry of the buffer
+   cache, which must be empty or evicted, first writing back the
+   entry's old contents if they are dirty.  If DATA is non-null,
+   copies the sector's contents from DATA instead of reading them.
+   The entry is marked in use by the caller.
+   This function should be called while holding the buffer cache
+   lock.  It releases the lock while the disk is busy, so that other
+   lookups need not wait for it; they wait on the entry instead. */
+void
+cache_read_disk (block_sector_t sector, int index, const void *data)
+{
+  struct cache_entry *e = &buffer_cache.cache[index];
+
+  e->evicting = e->valid && e->dirty;
+  e->old_sector = e->sector;
+  e->sector = sector;
+  e->loading = true;
+  e->dirty = false;
+  e->accessed = true;
+  e->owner = CACHE_NO_OWNER;
+  e->users = 1;
+  e->valid = true;
+
+  lock_release (&buffer_cache.lock);
+  if (e->evicting)
+    volume_write (e->old_sector, e->data);
+  if (data != NULL)
+    memcpy (e->data, data, BLOCK_SECTOR_SIZE);
+  else
+    volume_read (sector, e->data);
+  lock_acquire (&buffer_cache.lock);
+
+  e->evicting = false;
+  e->loading = false;
+  cond_broadcast (&buffer_cache.loaded, &buffer_cache.lock);
+}
+
+/* Which entries write_back() writes. */
+enum write_back_which
+  {
+    WB_DATA,                    /* Entries that hold file data. */
+    WB_ALL,                     /* All entries. */
+    WB_OWNER                    /* Data of one file. */
+  };
+
+/* Writes back every dirty entry selected by WHICH and, for
+   WB_OWNER, OWNER, if the journal has not pinned it, leaving the
+   entries in the cache.  Keeps up to WRITE_BACK_BATCH writes
+   queued on the disk at once, rather than waiting for each, so
+   that the I/O scheduler can order and merge them, and returns
+   once they have all completed.  Entries stay in use while their
+   writes are in flight, so that they cannot be evicted; each one is
+   checked and marked in use under the buffer cache lock, so that
+   it cannot be evicted in between either. */
+static void
+write_back (enum write_back_which which, block_sector_t owner)
+{
+  struct block_request reqs[WRITE_BACK_BATCH];
+  int indexes[WRITE_BACK_BATCH];
+  int i, cnt = 0;
+
+  lock_acquire (&buffer_cache.lock);
+  for (i = 0; i < CACHE_ENTRY_CNT; i++)
+    {
+      struct cache_entry *e = &buffer_cache.cache[i];
+      if (!e->valid || e->loading || !e->dirty || e->journaled
+          || (which == WB_DATA && e->owner == CACHE_NO_OWNER)
+          || (which == WB_OWNER && e->owner != owner))
+        continue;
 
-      if (buffer_cache.hand == start)
+      increment_users (i);
+      e->dirty = false;
+      indexes[cnt] = i;
+      block_request_init (&reqs[cnt],
+                          volume_device (sector_volume (e->sector)), true,
+                          sector_offset (e->sector), 1, e->data, NULL, NULL);
+      block_submit (&reqs[cnt++]);
+      if (cnt == WRITE_BACK_BATCH)
         {
-          if (first == true)
-            first = false;
-          else
+          lock_release (&buffer_cache.lock);
+          while (cnt > 0)
             {
-              first = true;
-              lock_release (&buffer_cache.lock);
-              //timer_sleep ();
-              lock_acquire (&buffer_cache.lock);
+              block_wait (&reqs[--cnt]);
+              decrement_users (indexes[cnt]);
             }
+          lock_acquire (&buffer_cache.lock);
         }
     }
+  lock_release (&buffer_cache.lock);
+  while (cnt > 0)
+    {
+      block_wait (&reqs[--cnt]);
+      decrement_users (indexes[cnt]);
+    }
+}
 
-  cache_clear (buffer_cache.hand);
-  return buffer_cache.hand;
+/* Writes every dirty entry that the journal has not pinned back to
+   disk, leaving the entries in the cache.  File data goes first, so
+   that no metadata reaches the disk before the data it refers to. */
+void
+cache_write_back (void)
+{
+  write_back (WB_DATA, CACHE_NO_OWNER);
+  write_back (WB_ALL, CACHE_NO_OWNER);
+}
+
+/* Writes the dirty data sectors of the file whose inode is in
+   sector OWNER back to disk. */
+void
+cache_write_back_owner (block_sector_t owner)
+{
+  write_back (WB_OWNER, owner);
 }
 
-/* Reads SECTOR from disk into the INDEX'th entry of the buffer cache.
-   This function should be called while holding the buffer cache lock. */
+/* Writes the dirty data sectors of every file back to disk. */
 void
-cache_read_disk (block_sector_t sector, int index)
+cache_write_back_data (void)
 {
-  buffer_cache.cache[index].sector = sector;
-  block_read (fs_device, sector, buffer_cache.cache[index].data);
-  buffer_cache.cache[index].dirty = false;
-  buffer_cache.cache[index].accessed = true;
-  buffer_cache.cache[index].users = 1;
-  buffer_cache.cache[index].valid = true;
+  write_back (WB_DATA, CACHE_NO_OWNER);
 }
 
 /* Flush the entire contents of the buffer cache back to disk. */
@@ -134,8 +440,9 @@ void
 cache_flush ()
 {
   int i;
-  for (i = 0; i < BUFFER_CACHE_SIZE; i++)
-    cache_clear (i);
+  for (i = 0; i < CACHE_ENTRY_CNT; i++)
+    if (buffer_cache.cache[i].valid)
+      cache_clear (i);
 }
 
 /* When the calling function is done reading or writing to the cache, it must
@@ -168,7 +475,7 @@ void
 cache_clear (int index)
 {
   buffer_cache.cache[index].valid = false;
-  //  if (buffer_cache.cache[index].dirty == true)
-    block_write (fs_device, buffer_cache.cache[index].sector,
-                 buffer_cache.cache[index].data);
+  if (buffer_cache.cache[index].dirty == true)
+    volume_write (buffer_cache.cache[index].sector,
+                  buffer_cache.cache[index].data);
 }
@@ -2,9 +2,22 @@
 #define FILESYS_CACHE_H
 
 #include "devices/block.h"
+#include "filesys/volume.h"
 #include "threads/synch.h"
 
+/* Each volume has its own partition of BUFFER_CACHE_SIZE entries,
+   so that traffic on one volume cannot evict another's sectors. */
 #define BUFFER_CACHE_SIZE 64
+#define CACHE_ENTRY_CNT (BUFFER_CACHE_SIZE * VOLUME_MAX)
+
+/* Owner of a cache entry that holds no file data. */
+#define CACHE_NO_OWNER ((block_sector_t) -1)
+
+/* Maximum number of sectors waiting to be prefetched. */
+#define PREFETCH_QUEUE_SIZE 32
+
+/* Maximum number of write-back requests in flight at once. */
+#define WRITE_BACK_BATCH 8
 
 /* Representation of a single disk block sector in the buffer cache. */
 struct cache_entry
@@ -16,23 +29,46 @@ struct cache_entry
     bool accessed;                     /* whether recently accessed. */
     struct lock lock;                  /* Lock on the cache entry. */
     int users;                         /* Number of readers & writers. */
+    bool journaled;                    /* Pinned until the journal commits. */
+    block_sector_t owner;              /* Inode sector of the file whose
+                                          data this is, or CACHE_NO_OWNER. */
+    bool loading;                      /* Being read in from disk. */
+    bool evicting;                     /* Old contents, of OLD_SECTOR,
+                                          being written back first. */
+    block_sector_t old_sector;         /* Sector it held before. */
   };
 
 /* Buffer cache keeps track of recently used disk block sectors. */
 struct buffer_cache
   {
-    struct cache_entry cache[BUFFER_CACHE_SIZE];    /* Buffer cache entries. */
-    int hand;                                       /* Clock hand; indexes
+    struct cache_entry cache[CACHE_ENTRY_CNT];      /* Buffer cache entries,
+                                                       partition by
+                                                       partition. */
+    int hand[VOLUME_MAX];                           /* Each partition's
+                                                       clock hand; indexes
                                                        cache. */
     struct lock lock;                               /* Buffer cache lock. */
+    struct condition loaded;                        /* Signaled when an
+                                                       entry has been
+                                                       read in. */
   };
 
 struct buffer_cache buffer_cache;       /* (Global) buffer cache. */
 
 void cache_init (void);
+void cache_prefetch_init (void);
 int cache_lookup (block_sector_t);
+int cache_overwrite (block_sector_t, const void *);
+int cache_find (block_sector_t);
 void cache_operation_done (int);
 
+void cache_read (block_sector_t, void *);
+void cache_write (block_sector_t, const void *);
+void cache_prefetch (block_sector_t);
+
+void cache_write_back (void);
+void cache_write_back_owner (block_sector_t);
+void cache_write_back_data (void);
 void cache_flush (void);
 
 #endif /* filesys/cache.h */
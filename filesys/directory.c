@@ -1,7 +1,9 @@
 #include "filesys/directory.h"
+#include <bitmap.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -24,6 +26,7 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      dir->prefetch_pos = 0;
       inode->object = dir;
       return dir;
     }
@@ -69,6 +72,78 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Minimum number of slots tracked by a directory's slot map. */
+#define MIN_SLOT_CNT 16
+
+/* Builds the in-memory map of in-use entry slots and the live
+   entry count for directory INODE, unless that has already been
+   done.  All openers of INODE share the map, which dir_add() and
+   dir_remove() keep up to date from then on, along with a hint
+   that lets dir_add() skip the slots known to be in use.
+   Returns true if successful, false if memory is exhausted. */
+static bool
+load_slots (struct inode *inode)
+{
+  struct dir_entry e;
+  size_t slot_cnt, i;
+
+  if (inode->dir_slots != NULL)
+    return true;
+
+  slot_cnt = inode_length (inode) / sizeof e;
+  inode->dir_slots = bitmap_create (slot_cnt > MIN_SLOT_CNT
+                                    ? slot_cnt : MIN_SLOT_CNT);
+  if (inode->dir_slots == NULL)
+    return false;
+
+  inode->dir_entry_cnt = 0;
+  inode->dir_free_hint = 0;
+  for (i = 0; i < slot_cnt; i++)
+    if (inode_read_at (inode, &e, sizeof e, i * sizeof e) == sizeof e
+        && e.in_use)
+      {
+        bitmap_mark (inode->dir_slots, i);
+        inode->dir_entry_cnt++;
+      }
+  return true;
+}
+
+/* Doubles the capacity of directory INODE's slot map, which must
+   be full.  Returns true if successful, false if memory is
+   exhausted. */
+static bool
+grow_slots (struct inode *inode)
+{
+  size_t old_cnt = bitmap_size (inode->dir_slots);
+  struct bitmap *slots;
+
+  ASSERT (bitmap_all (inode->dir_slots, 0, old_cnt));
+
+  slots = bitmap_create (old_cnt * 2);
+  if (slots == NULL)
+    return false;
+  bitmap_set_multiple (slots, 0, old_cnt, true);
+  bitmap_destroy (inode->dir_slots);
+  inode->dir_slots = slots;
+  return true;
+}
+
+/* Returns true if directory INODE contains no entries. */
+static bool
+slots_empty (struct inode *inode)
+{
+  return load_slots (inode) && inode->dir_entry_cnt == 0;
+}
+
+/* Returns true if DIR contains no entries, false if it has
+   entries or memory is exhausted. */
+bool
+dir_is_empty (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return slots_empty (dir->inode);
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -102,7 +177,8 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.  If a volume is
+   mounted on the file, *INODE is the volume's root directory. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
@@ -114,13 +190,35 @@ dir_lookup (const struct dir *dir, const char *name,
 
 
   if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector, e.isdir);
+    *inode = inode_open (volume_follow_mount (e.inode_sector), e.isdir);
   else
     *inode = NULL;
 
   return *inode != NULL;
 }
 
+/* Searches DIR for a file with the given NAME without opening
+   its inode.  If one exists, sets *SECTORP to its inode sector, or
+   that of the root directory of the volume mounted on it, and
+   *ISDIR to whether it is a directory and returns true; otherwise
+   returns false. */
+bool
+dir_lookup_sector (const struct dir *dir, const char *name,
+                   block_sector_t *sectorp, bool *isdir)
+{
+  struct dir_entry e;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  if (!lookup (dir, name, &e, NULL))
+    return false;
+
+  *sectorp = volume_follow_mount (e.inode_sector);
+  *isdir = e.isdir;
+  return true;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -132,6 +230,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
          bool isdir)
 {
   struct dir_entry e;
+  size_t slot;
   off_t ofs;
   bool success = false;
 
@@ -146,24 +245,39 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Take a free slot from the slot map, searching from the first
+     slot that may be free.
+     If every slot up to the current end-of-file is in use, the
+     first free slot is the one just past end-of-file, so the
+     write below extends the directory. */
+  if (!load_slots (dir->inode))
+    goto done;
+  slot = bitmap_scan_and_flip (dir->inode->dir_slots,
+                               dir->inode->dir_free_hint, 1, false);
+  if (slot == BITMAP_ERROR)
+    {
+      slot = bitmap_size (dir->inode->dir_slots);
+      if (!grow_slots (dir->inode))
+        goto done;
+      bitmap_mark (dir->inode->dir_slots, slot);
+    }
+  dir->inode->dir_free_hint = slot + 1;
+  ofs = slot * sizeof e;
 
   /* Write slot. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   e.isdir = isdir;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    dir->inode->dir_entry_cnt++;
+  else
+    {
+      bitmap_reset (dir->inode->dir_slots, slot);
+      dir->inode->dir_free_hint = slot;
+    }
 
  done:
   return success;
@@ -171,7 +285,9 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
 
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME or if
+   NAME is a directory that is not empty or has a volume mounted
+   on it. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
@@ -184,7 +300,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &ofs) || volume_is_mount_point (e.inode_sector))
     goto done;
 
   /* Open inode. */
@@ -192,10 +308,22 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Directories must be emptied before they can be removed. */
+  if (e.isdir && !slots_empty (inode))
+    goto done;
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (dir->inode->dir_slots != NULL)
+    {
+      size_t slot = ofs / sizeof e;
+      bitmap_reset (dir->inode->dir_slots, slot);
+      dir->inode->dir_entry_cnt--;
+      if (slot < dir->inode->dir_free_hint)
+        dir->inode->dir_free_hint = slot;
+    }
 
   /* Remove inode. */
   inode_remove (inode);
@@ -206,6 +334,33 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Number of directory entries, starting with the one just
+   returned by dir_readdir(), whose inodes are prefetched. */
+#define PREFETCH_ENTRIES 8
+
+/* Queues the inode sectors of the entries of DIR in the
+   PREFETCH_ENTRIES slots starting at byte offset OFS for
+   asynchronous prefetch.  A program iterating a directory usually
+   opens or stats each entry next, so this overlaps their inode reads
+   with its own processing.  Entries already queued are skipped. */
+static void
+prefetch_inodes (struct dir *dir, off_t ofs)
+{
+  struct dir_entry e;
+  off_t end = ofs + PREFETCH_ENTRIES * sizeof e;
+
+  if (dir->prefetch_pos < ofs)
+    dir->prefetch_pos = ofs;
+  while (dir->prefetch_pos < end
+         && inode_read_at (dir->inode, &e, sizeof e,
+                           dir->prefetch_pos) == sizeof e)
+    {
+      dir->prefetch_pos += sizeof e;
+      if (e.in_use)
+        cache_prefetch (e.inode_sector);
+    }
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
@@ -220,6 +375,7 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
+          prefetch_inodes (dir, dir->pos - sizeof e);
           return true;
         } 
     }
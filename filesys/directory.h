@@ -18,6 +18,8 @@ struct dir
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
+    off_t prefetch_pos;                 /* Entries before this offset have
+                                           had their inodes prefetched. */
   };
 
 /* A single directory entry. */
@@ -44,8 +46,11 @@ struct inode *dir_get_inode (struct dir *);
 
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
+bool dir_lookup_sector (const struct dir *, const char *name,
+                        block_sector_t *, bool *isdir);
 bool dir_add (struct dir *, const char *name, block_sector_t, bool isdir);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_is_empty (struct dir *);
 
 #endif /* filesys/directory.h */
@@ -0,0 +1,463 @@
+#include "filesys/extent.h"
+#include <debug.h>
+#include "threads/malloc.h"
+
+static void destroy_subtree (struct extent *);
+
+/* Returns the height of the subtree rooted at E. */
+static int
+height (const struct extent *e)
+{
+  return e != NULL ? e->height : 0;
+}
+
+/* Returns the size of the largest extent in the subtree rooted
+   at E. */
+static block_sector_t
+max_cnt (const struct extent *e)
+{
+  return e != NULL ? e->max_cnt : 0;
+}
+
+/* Recomputes E's height and max_cnt from its children. */
+static void
+update (struct extent *e)
+{
+  int left_height = height (e->left);
+  int right_height = height (e->right);
+
+  e->height = (left_height > right_height ? left_height : right_height) + 1;
+  e->max_cnt = e->cnt;
+  if (max_cnt (e->left) > e->max_cnt)
+    e->max_cnt = max_cnt (e->left);
+  if (max_cnt (e->right) > e->max_cnt)
+    e->max_cnt = max_cnt (e->right);
+}
+
+/* Rotates the subtree rooted at E to the right and returns its
+   new root. */
+static struct extent *
+rotate_right (struct extent *e)
+{
+  struct extent *l = e->left;
+
+  e->left = l->right;
+  l->right = e;
+  update (e);
+  update (l);
+  return l;
+}
+
+/* Rotates the subtree rooted at E to the left and returns its
+   new root. */
+static struct extent *
+rotate_left (struct extent *e)
+{
+  struct extent *r = e->right;
+
+  e->right = r->left;
+  r->left = e;
+  update (e);
+  update (r);
+  return r;
+}
+
+/* Updates E after one of its subtrees has changed height by at
+   most one, rotating as necessary to restore the AVL balance
+   condition.  Returns the new root of the subtree. */
+static struct extent *
+rebalance (struct extent *e)
+{
+  int balance;
+
+  update (e);
+  balance = height (e->left) - height (e->right);
+  if (balance > 1)
+    {
+      if (height (e->left->left) < height (e->left->right))
+        e->left = rotate_left (e->left);
+      return rotate_right (e);
+    }
+  else if (balance < -1)
+    {
+      if (height (e->right->right) < height (e->right->left))
+        e->right = rotate_right (e->right);
+      return rotate_left (e);
+    }
+  return e;
+}
+
+/* Inserts NEW into the subtree rooted at E and returns the new
+   root of the subtree. */
+static struct extent *
+insert (struct extent *e, struct extent *new)
+{
+  if (e == NULL)
+    return new;
+
+  if (new->start < e->start)
+    e->left = insert (e->left, new);
+  else
+    e->right = insert (e->right, new);
+  return rebalance (e);
+}
+
+/* Unlinks the lowest extent from the subtree rooted at E, which
+   must not be empty, and stores it in *MINP.  Returns the new root
+   of the subtree. */
+static struct extent *
+remove_min (struct extent *e, struct extent **minp)
+{
+  if (e->left == NULL)
+    {
+      *minp = e;
+      return e->right;
+    }
+
+  e->left = remove_min (e->left, minp);
+  return rebalance (e);
+}
+
+/* Unlinks the extent that starts at START from the subtree rooted
+   at E, which must contain it, and stores it in *REMOVEDP.
+   Returns the new root of the subtree. */
+static struct extent *
+remove_extent (struct extent *e, block_sector_t start,
+               struct extent **removedp)
+{
+  ASSERT (e != NULL);
+
+  if (start < e->start)
+    e->left = remove_extent (e->left, start, removedp);
+  else if (start > e->start)
+    e->right = remove_extent (e->right, start, removedp);
+  else
+    {
+      struct extent *min;
+
+      *removedp = e;
+      if (e->right == NULL)
+        return e->left;
+      e->right = remove_min (e->right, &min);
+      min->left = e->left;
+      min->right = e->right;
+      return rebalance (min);
+    }
+  return rebalance (e);
+}
+
+/* Recomputes the summaries of every node on the path from E down
+   to the extent that starts at START, after that extent's size
+   has changed in place. */
+static void
+update_path (struct extent *e, block_sector_t start)
+{
+  if (e == NULL)
+    return;
+
+  if (start < e->start)
+    update_path (e->left, start);
+  else if (start > e->start)
+    update_path (e->right, start);
+  update (e);
+}
+
+/* Returns the extent in the subtree rooted at E that starts at
+   SECTOR, or a null pointer if there is none. */
+static struct extent *
+find_starting_at (struct extent *e, block_sector_t sector)
+{
+  while (e != NULL && e->start != sector)
+    e = sector < e->start ? e->left : e->right;
+  return e;
+}
+
+/* Returns the extent in the subtree rooted at E whose last
+   sector is SECTOR - 1, or a null pointer if there is none. */
+static struct extent *
+find_ending_at (struct extent *e, block_sector_t sector)
+{
+  while (e != NULL && e->start + e->cnt != sector)
+    e = e->start + e->cnt < sector ? e->right : e->left;
+  return e;
+}
+
+/* Returns the lowest extent in the subtree rooted at E that has
+   at least CNT sectors, or a null pointer if there is none. */
+static struct extent *
+first_fit (struct extent *e, block_sector_t cnt)
+{
+  while (e != NULL && e->max_cnt >= cnt)
+    {
+      if (max_cnt (e->left) >= cnt)
+        e = e->left;
+      else if (e->cnt >= cnt)
+        return e;
+      else
+        e = e->right;
+    }
+  return NULL;
+}
+
+/* Returns the lowest extent in the subtree rooted at E that
+   starts at or after sector FROM and has at least CNT sectors, or
+   a null pointer if there is none. */
+static struct extent *
+first_fit_from (struct extent *e, block_sector_t cnt, block_sector_t from)
+{
+  struct extent *found;
+
+  if (e == NULL || e->max_cnt < cnt)
+    return NULL;
+  if (e->start < from)
+    return first_fit_from (e->right, cnt, from);
+
+  found = first_fit_from (e->left, cnt, from);
+  if (found == NULL)
+    found = e->cnt >= cnt ? e : first_fit (e->right, cnt);
+  return found;
+}
+
+/* Returns the extent in the subtree rooted at E that contains
+   SECTOR, or a null pointer if there is none. */
+static struct extent *
+find_containing (struct extent *e, block_sector_t sector)
+{
+  while (e != NULL)
+    {
+      if (sector < e->start)
+        e = e->left;
+      else if (sector - e->start >= e->cnt)
+        e = e->right;
+      else
+        break;
+    }
+  return e;
+}
+
+/* Removes the first CNT sectors of E, which must have at least
+   that many, from TREE. */
+static void
+take_front (struct extent_tree *tree, struct extent *e, block_sector_t cnt)
+{
+  ASSERT (e->cnt >= cnt);
+
+  if (e->cnt == cnt)
+    {
+      struct extent *removed;
+
+      tree->root = remove_extent (tree->root, e->start, &removed);
+      free (removed);
+      tree->extent_cnt--;
+    }
+  else
+    {
+      e->start += cnt;
+      e->cnt -= cnt;
+      update_path (tree->root, e->start);
+    }
+  tree->sector_cnt -= cnt;
+}
+
+/* Initializes TREE as an empty extent tree. */
+void
+extent_tree_init (struct extent_tree *tree)
+{
+  tree->root = NULL;
+  tree->extent_cnt = 0;
+  tree->sector_cnt = 0;
+}
+
+/* Frees all the extents in TREE, leaving it empty. */
+void
+extent_tree_destroy (struct extent_tree *tree)
+{
+  destroy_subtree (tree->root);
+  extent_tree_init (tree);
+}
+
+/* Adds the CNT sectors starting at START, none of which may
+   already be in TREE, merging them with any adjacent extents.
+   Returns true if successful, false if memory is exhausted. */
+bool
+extent_tree_add (struct extent_tree *tree, block_sector_t start,
+                 block_sector_t cnt)
+{
+  struct extent *prev, *next;
+
+  ASSERT (cnt > 0);
+
+  prev = find_ending_at (tree->root, start);
+  next = find_starting_at (tree->root, start + cnt);
+  if (prev != NULL && next != NULL)
+    {
+      struct extent *removed;
+
+      tree->root = remove_extent (tree->root, next->start, &removed);
+      prev->cnt += cnt + removed->cnt;
+      update_path (tree->root, prev->start);
+      free (removed);
+      tree->extent_cnt--;
+    }
+  else if (prev != NULL)
+    {
+      prev->cnt += cnt;
+      update_path (tree->root, prev->start);
+    }
+  else if (next != NULL)
+    {
+      /* Moving NEXT's start down to START keeps the tree ordered,
+         because no extent lies between them. */
+      next->start = start;
+      next->cnt += cnt;
+      update_path (tree->root, next->start);
+    }
+  else
+    {
+      struct extent *e = malloc (sizeof *e);
+      if (e == NULL)
+        return false;
+      e->start = start;
+      e->cnt = cnt;
+      e->max_cnt = cnt;
+      e->height = 1;
+      e->left = e->right = NULL;
+      tree->root = insert (tree->root, e);
+      tree->extent_cnt++;
+    }
+
+  tree->sector_cnt += cnt;
+  return true;
+}
+
+/* Removes CNT consecutive sectors from TREE, taking them from the
+   start of the lowest extent that is large enough, and stores the
+   first of them in *STARTP.  Returns true if successful, false if
+   no extent has CNT sectors. */
+bool
+extent_tree_take (struct extent_tree *tree, block_sector_t cnt,
+                  block_sector_t *startp)
+{
+  struct extent *e;
+
+  ASSERT (cnt > 0);
+
+  e = first_fit (tree->root, cnt);
+  if (e == NULL)
+    return false;
+
+  *startp = e->start;
+  take_front (tree, e, cnt);
+  return true;
+}
+
+/* Removes CNT consecutive sectors from TREE, taking them from the
+   start of the lowest extent that is large enough and starts in
+   sectors FROM through TO - 1, and stores the first of them in
+   *STARTP.  Returns true if successful, false if there is no such
+   extent. */
+bool
+extent_tree_take_within (struct extent_tree *tree, block_sector_t cnt,
+                         block_sector_t from, block_sector_t to,
+                         block_sector_t *startp)
+{
+  struct extent *e;
+
+  ASSERT (cnt > 0);
+
+  e = first_fit_from (tree->root, cnt, from);
+  if (e == NULL || e->start >= to)
+    return false;
+
+  *startp = e->start;
+  take_front (tree, e, cnt);
+  return true;
+}
+
+/* Removes CNT consecutive sectors from TREE, as
+   extent_tree_take_within() does, except that the first of them is
+   a sector S with S % ALIGN == SKEW, and stores it in *STARTP.  The
+   sectors may come from the middle of an extent.  Returns true if
+   successful, false if there is no such extent or if memory is
+   exhausted. */
+bool
+extent_tree_take_aligned (struct extent_tree *tree, block_sector_t cnt,
+                          block_sector_t align, block_sector_t skew,
+                          block_sector_t from, block_sector_t to,
+                          block_sector_t *startp)
+{
+  struct extent *e;
+  block_sector_t start;
+
+  ASSERT (cnt > 0);
+  ASSERT (skew < align);
+
+  /* Any extent this large has an aligned run of CNT sectors. */
+  e = first_fit_from (tree->root, cnt + align - 1, from);
+  if (e == NULL || e->start >= to)
+    return false;
+
+  start = e->start + (skew + align - e->start % align) % align;
+  if (!extent_tree_take_at (tree, start, cnt))
+    return false;
+  *startp = start;
+  return true;
+}
+
+/* Removes the CNT sectors starting at START from TREE.  Returns
+   true if successful, false if those sectors are not all within a
+   single extent of TREE or if memory is exhausted. */
+bool
+extent_tree_take_at (struct extent_tree *tree, block_sector_t start,
+                     block_sector_t cnt)
+{
+  struct extent *e;
+  block_sector_t end;
+
+  ASSERT (cnt > 0);
+
+  e = find_containing (tree->root, start);
+  if (e == NULL || e->start + e->cnt - start < cnt)
+    return false;
+
+  end = e->start + e->cnt;
+  if (start == e->start)
+    take_front (tree, e, cnt);
+  else if (start + cnt == end)
+    {
+      e->cnt -= cnt;
+      update_path (tree->root, e->start);
+      tree->sector_cnt -= cnt;
+    }
+  else
+    {
+      /* Split E around the sectors taken. */
+      struct extent *tail = malloc (sizeof *tail);
+      if (tail == NULL)
+        return false;
+      tail->start = start + cnt;
+      tail->cnt = end - tail->start;
+      tail->max_cnt = tail->cnt;
+      tail->height = 1;
+      tail->left = tail->right = NULL;
+
+      e->cnt = start - e->start;
+      update_path (tree->root, e->start);
+      tree->root = insert (tree->root, tail);
+      tree->extent_cnt++;
+      tree->sector_cnt -= cnt;
+    }
+  return true;
+}
+
+/* Frees E and all of its descendants. */
+static void
+destroy_subtree (struct extent *e)
+{
+  if (e != NULL)
+    {
+      destroy_subtree (e->left);
+      destroy_subtree (e->right);
+      free (e);
+    }
+}
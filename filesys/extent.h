@@ -0,0 +1,47 @@
+#ifndef FILESYS_EXTENT_H
+#define FILESYS_EXTENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* A run of CNT consecutive sectors starting at START.
+   Node in an extent tree. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    block_sector_t max_cnt;             /* Largest CNT in this subtree. */
+    int height;                         /* Height of this subtree. */
+    struct extent *left, *right;        /* Children. */
+  };
+
+/* Set of disjoint extents, kept in a balanced (AVL) tree ordered
+   by starting sector.  Each node also records the size of the
+   largest extent below it, so that the lowest extent of at least a
+   given size can be found in O(log n) time.  Adjacent extents are
+   always coalesced. */
+struct extent_tree
+  {
+    struct extent *root;                /* Root node. */
+    size_t extent_cnt;                  /* Number of extents. */
+    block_sector_t sector_cnt;          /* Total sectors in all extents. */
+  };
+
+void extent_tree_init (struct extent_tree *);
+void extent_tree_destroy (struct extent_tree *);
+bool extent_tree_add (struct extent_tree *, block_sector_t start,
+                      block_sector_t cnt);
+bool extent_tree_take (struct extent_tree *, block_sector_t cnt,
+                       block_sector_t *startp);
+bool extent_tree_take_within (struct extent_tree *, block_sector_t cnt,
+                              block_sector_t from, block_sector_t to,
+                              block_sector_t *startp);
+bool extent_tree_take_at (struct extent_tree *, block_sector_t start,
+                          block_sector_t cnt);
+bool extent_tree_take_aligned (struct extent_tree *, block_sector_t cnt,
+                               block_sector_t align, block_sector_t skew,
+                               block_sector_t from, block_sector_t to,
+                               block_sector_t *startp);
+
+#endif /* filesys/extent.h */
@@ -3,6 +3,11 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+static off_t readv_at (struct file *, const struct iovec *, int iov_cnt,
+                       off_t file_ofs);
+static off_t writev_at (struct file *, const struct iovec *, int iov_cnt,
+                        off_t file_ofs);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -15,6 +20,7 @@ file_open (struct inode *inode)
        file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->direct = false;
       inode->object = file;
       return file;
     }
@@ -61,7 +67,8 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  struct iovec iov = { buffer, size };
+  off_t bytes_read = readv_at (file, &iov, 1, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -74,7 +81,8 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  struct iovec iov = { buffer, size };
+  return readv_at (file, &iov, 1, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -87,7 +95,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  struct iovec iov = { (void *) buffer, size };
+  off_t bytes_written = writev_at (file, &iov, 1, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -103,7 +112,63 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
-  return inode_write_at (file->inode, buffer, size, file_ofs);
+  struct iovec iov = { (void *) buffer, size };
+  return writev_at (file, &iov, 1, file_ofs);
+}
+
+/* Reads from FILE into the IOV_CNT buffers in IOV, in order,
+   starting at the file's current position.
+   Returns the number of bytes actually read,
+   which may be less than the buffers' total size if end of file
+   is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iov_cnt)
+{
+  off_t bytes_read = readv_at (file, iov, iov_cnt, file->pos);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the IOV_CNT buffers in IOV, in order, into FILE,
+   starting at the file's current position.
+   Returns the number of bytes actually written.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iov_cnt)
+{
+  off_t bytes_written = writev_at (file, iov, iov_cnt, file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from IN, starting at its current
+   position, to OUT, starting at its current position, without
+   passing them through a caller's buffer.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if end of IN is reached or OUT cannot grow.
+   Advances both files' positions by the number of bytes copied.
+   IN and OUT must be different files. */
+off_t
+file_copy (struct file *out, struct file *in, off_t size)
+{
+  ASSERT (in->inode != out->inode);
+
+  off_t bytes_copied = inode_copy_at (out->inode, out->pos,
+                                      in->inode, in->pos, size);
+  in->pos += bytes_copied;
+  out->pos += bytes_copied;
+  return bytes_copied;
+}
+
+/* Turns uncached I/O on FILE on or off, according to DIRECT.
+   While it is on, whole sectors that are not in the buffer cache
+   move directly between the caller's buffers and the disk. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -159,3 +224,25 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Reads from FILE at FILE_OFS into the IOV_CNT buffers in IOV,
+   bypassing the buffer cache if FILE is in uncached mode. */
+static off_t
+readv_at (struct file *file, const struct iovec *iov, int iov_cnt,
+          off_t file_ofs)
+{
+  if (file->direct)
+    return inode_readv_direct (file->inode, iov, iov_cnt, file_ofs);
+  return inode_readv (file->inode, iov, iov_cnt, file_ofs);
+}
+
+/* Writes the IOV_CNT buffers in IOV into FILE at FILE_OFS,
+   bypassing the buffer cache if FILE is in uncached mode. */
+static off_t
+writev_at (struct file *file, const struct iovec *iov, int iov_cnt,
+           off_t file_ofs)
+{
+  if (file->direct)
+    return inode_writev_direct (file->inode, iov, iov_cnt, file_ofs);
+  return inode_writev (file->inode, iov, iov_cnt, file_ofs);
+}
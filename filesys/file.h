@@ -11,6 +11,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Bypass the buffer cache? */
     struct hash_elem elem;      /* Hashtable element. */
   };
 
@@ -25,6 +26,12 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_readv (struct file *, const struct iovec *, int iov_cnt);
+off_t file_writev (struct file *, const struct iovec *, int iov_cnt);
+off_t file_copy (struct file *out, struct file *in, off_t size);
+
+/* Uncached I/O. */
+void file_set_direct (struct file *, bool);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
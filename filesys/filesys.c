@@ -7,9 +7,10 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
-static void do_format (void);
+static void do_format (int volume);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -19,14 +20,22 @@ filesys_init (bool format)
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
+  if (block_size (fs_device) >= VOLUME_SECTORS)
+    PANIC ("file system device is too large");
+  if (!format && journal_volume (fs_device) > 0)
+    PANIC ("%s holds a file system for mounting, not a root file system",
+           block_name (fs_device));
+  volume_attach (0, fs_device, 0);
 
   inode_init ();
-  free_map_init ();
+  cache_prefetch_init ();
+  free_map_init (0);
 
   if (format) 
-    do_format ();
+    do_format (0);
 
-  free_map_open ();
+  journal_open (0);
+  free_map_open (0);
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -34,10 +43,90 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  int volume;
+
+  for (volume = 0; volume < VOLUME_MAX; volume++)
+    if (volume_device (volume) != NULL)
+      free_map_close (volume);
+  journal_close ();
   cache_flush ();
-  free_map_close ();
 }
 
+/* Writes all file data, then all metadata, to disk. */
+void
+filesys_sync (void)
+{
+  cache_write_back ();
+  journal_sync ();
+}
+
+/* Mounts the file system on DEVICE on the directory named DIR,
+   creating DIR if it does not exist, as a volume of its own.  If
+   FORMAT is true, formats DEVICE first, giving it the lowest unused
+   volume number; otherwise DEVICE must hold a file system formatted
+   for mounting, which keeps the volume number it was formatted
+   with.  Must be called during startup, before any process runs.
+   Returns true if successful, false on failure. */
+bool
+filesys_mount (const char *dir, struct block *device, bool format)
+{
+  block_sector_t mount_point;
+  off_t length;
+  bool isdir;
+  int volume, i;
+
+  for (i = 0; i < BLOCK_ROLE_CNT; i++)
+    if (block_get_role (i) == device)
+      {
+        printf ("filesys: %s is in use\n", block_name (device));
+        return false;
+      }
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (volume_device (i) == device)
+      {
+        printf ("filesys: %s is already mounted\n", block_name (device));
+        return false;
+      }
+  if (block_size (device) >= VOLUME_SECTORS)
+    {
+      printf ("filesys: %s is too large\n", block_name (device));
+      return false;
+    }
+
+  volume = format ? volume_unused () : journal_volume (device);
+  if (volume <= 0 || volume >= VOLUME_MAX || volume_device (volume) != NULL)
+    {
+      if (format)
+        printf ("filesys: too many mounted file systems\n");
+      else
+        printf ("filesys: %s: no file system for mounting, or its volume "
+                "number is in use\n", block_name (device));
+      return false;
+    }
+
+  /* Creating DIR fails harmlessly if it already exists.  The root
+     directory, or one that a volume is mounted on, looks like a
+     volume's root directory. */
+  journal_begin ();
+  filesys_create (dir, 0, true);
+  journal_end ();
+  if (!filesys_stat (dir, &length, &isdir, &mount_point) || !isdir
+      || sector_offset (mount_point) == ROOT_DIR_SECTOR)
+    {
+      printf ("filesys: can't mount on %s\n", dir);
+      return false;
+    }
+
+  volume_attach (volume, device, mount_point);
+  free_map_init (volume);
+  if (format)
+    do_format (volume);
+  journal_open (volume);
+  free_map_open (volume);
+  printf ("filesys: mounted %s on %s\n", block_name (device), dir);
+  return true;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -61,9 +150,12 @@ filesys_create (const char *name_, off_t initial_size, bool isdir)
       bool found = dir_lookup (dir, token, &inode);
       if (!found)
         {
+          /* Place the new inode near its parent directory's. */
+          block_sector_t goal = (dir != NULL
+                                 ? inode_get_inumber (dir_get_inode (dir)) : 0);
           block_sector_t inode_sector = 0;
           bool success = (dir != NULL
-                          && free_map_allocate (1, &inode_sector)
+                          && free_map_allocate_near (1, goal, &inode_sector)
                           && inode_create (inode_sector, initial_size)
                           && dir_add (dir, token, inode_sector, isdir));
           if (!success && inode_sector != 0) 
@@ -168,14 +260,101 @@ filesys_remove (const char *name_)
     }
 }
 
-/* Formats the file system. */
+/* Creates a file named DST with the same contents as the existing
+   file SRC.  The two files share their data sectors until one of
+   them writes to a sector, so this costs time and space in
+   proportion to SRC's metadata, not its data.
+   Returns true if successful, false otherwise.
+   Fails if SRC does not exist or is a directory, if a file named DST
+   already exists, or if memory or disk space runs out. */
+bool
+filesys_clone (const char *src, const char *dst)
+{
+  struct inode *src_inode = filesys_open (src);
+  struct inode *dst_inode;
+  bool success;
+
+  if (src_inode == NULL || src_inode->isdir
+      || !filesys_create (dst, 0, false))
+    {
+      inode_close (src_inode);
+      return false;
+    }
+
+  dst_inode = filesys_open (dst);
+  success = dst_inode != NULL && inode_clone (dst_inode, src_inode);
+  inode_close (dst_inode);
+  inode_close (src_inode);
+  if (!success)
+    filesys_remove (dst);
+  return success;
+}
+
+/* Looks up the file or directory named NAME without opening it
+   or allocating a file descriptor.  On success, stores its length
+   in *LENGTH, whether it is a directory in *ISDIR and its inode
+   sector in *INUMBER, and returns true.
+   Fails if no file named NAME exists,
+   or if an internal memory allocation fails. */
+bool
+filesys_stat (const char *name_, off_t *length, bool *isdir,
+              block_sector_t *inumber)
+{
+  block_sector_t sector = ROOT_DIR_SECTOR;
+  bool found = true;
+
+  *isdir = true;
+  if (strcmp (name_, "/") != 0)
+    {
+      char *name = malloc (strlen (name_) + 1);
+      if (name == NULL)
+        return false;
+      strlcpy (name, name_, strlen (name_) + 1);
+
+      struct dir *dir = dir_open_root ();
+      char *token, *next, *save_ptr;
+
+      /* Walk down to the directory containing the last component. */
+      for (token = strtok_r (name, "/", &save_ptr); token != NULL;
+           token = next)
+        {
+          struct inode *inode;
+
+          next = strtok_r (NULL, "/", &save_ptr);
+          if (next == NULL)
+            break;
+          if (dir == NULL || !dir_lookup (dir, token, &inode))
+            {
+              token = NULL;
+              break;
+            }
+          dir_close (dir);
+          dir = dir_open (inode);
+        }
+
+      found = (dir != NULL && token != NULL
+               && dir_lookup_sector (dir, token, &sector, isdir));
+      dir_close (dir);
+      free (name);
+    }
+
+  if (found)
+    {
+      found = inode_sector_length (sector, length);
+      *inumber = sector;
+    }
+  return found;
+}
+
+/* Formats the file system on VOLUME. */
 static void
-do_format (void)
+do_format (int volume)
 {
   printf ("Formatting file system...");
-  free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  free_map_create (volume);
+  journal_create (volume);
+  if (!dir_create (volume_sector (volume, ROOT_DIR_SECTOR), 16))
     PANIC ("root directory creation failed");
-  free_map_close ();
+  free_map_close (volume);
   printf ("done.\n");
 }
@@ -2,7 +2,9 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include "devices/block.h"
 #include "filesys/off_t.h"
+#include "filesys/volume.h"
 #include "threads/synch.h"
 
 /* Partiton that contains the file system. */
@@ -12,17 +14,24 @@ struct block *fs_device;
    synchronization, so this will have to suffice. */
 struct lock filesys_lock;
 
-/* Sectors of system file inodes. */
+/* Sectors of system file inodes, within each volume. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+#define REFCOUNT_SECTOR 3       /* Reference count file inode sector. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
 void filesys_init (bool format);
 void filesys_done (void);
+void filesys_sync (void);
+bool filesys_mount (const char *dir, struct block *, bool format);
 bool filesys_create (const char *name, off_t initial_size, bool isdir);
 struct inode *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_clone (const char *src, const char *dst);
+bool filesys_stat (const char *name, off_t *length, bool *isdir,
+                   block_sector_t *inumber);
 
 #endif /* filesys/filesys.h */
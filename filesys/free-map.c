@@ -1,98 +1,454 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
 #include <stdio.h>
+#include "filesys/extent.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/refcount.h"
+#include "threads/malloc.h"
 
-static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per sector. */
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * CHAR_BIT)
 
-/* Initializes the free map. */
+/* The disk is divided into block groups of GROUP_SECTORS sectors
+   each.  Allocation prefers the group of the caller's goal sector,
+   so that a file's inode lands near its directory and its data near
+   its inode, and otherwise the nearest following group with enough
+   free space, as tracked in GROUP_FREE. */
+#define GROUP_SECTORS 1024
+
+/* Runs of at least ALIGN_SECTORS sectors are started, when
+   possible, on a multiple of ALIGN_SECTORS sectors from the start
+   of the underlying disk, not just of the partition, so that they
+   do not straddle the disk's physical blocks. */
+#define ALIGN_SECTORS 8
+
+/* A volume's free map.  Bits are indexed by sector offset within
+   the volume. */
+struct free_map
+  {
+    struct file *file;                  /* Free map file. */
+    struct bitmap *map;                 /* Free map, one bit per sector. */
+
+    /* Sectors of the free map file whose bits have changed since
+       they were last written, one bit per sector.  Changes are
+       written back together by free_map_flush(), rather than
+       rewriting the whole free map on every allocation and
+       release. */
+    struct bitmap *dirty_map;
+    size_t dirty_cnt;                   /* Number of bits set in
+                                           DIRTY_MAP. */
+
+    /* Free sectors, indexed as extents so that allocation does not
+       have to scan the bitmap.  Mirrors the free bits in MAP while
+       FREE_EXTENTS_VALID is true; if building or updating the index
+       ever runs out of memory, allocation falls back to scanning
+       MAP. */
+    struct extent_tree free_extents;
+    bool free_extents_valid;
+
+    size_t group_cnt;                   /* Number of block groups. */
+    block_sector_t *group_free;         /* Free sectors in each group. */
+
+    block_sector_t align_skew;          /* Offset of the first aligned
+                                           sector, below ALIGN_SECTORS. */
+  };
+
+static struct free_map free_maps[VOLUME_MAX];
+
+static void build_free_extents (struct free_map *);
+static void add_free_extent (struct free_map *, block_sector_t, size_t);
+static void mark_dirty (struct free_map *, block_sector_t, size_t);
+static void release_run (struct free_map *, block_sector_t, size_t);
+static void count_group_free (struct free_map *);
+static void adjust_group_free (struct free_map *, block_sector_t, size_t,
+                               bool allocated);
+static bool take_from_group (struct free_map *, size_t group,
+                             block_sector_t from, size_t cnt,
+                             block_sector_t *sectorp);
+
+/* Initializes the free map of VOLUME, which must be attached. */
 void
-free_map_init (void) 
+free_map_init (int volume) 
 {
-  free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  struct free_map *fm = &free_maps[volume];
+  struct block *device = volume_device (volume);
+
+  fm->map = bitmap_create (block_size (device));
+  if (fm->map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  bitmap_mark (fm->map, FREE_MAP_SECTOR);
+  bitmap_mark (fm->map, ROOT_DIR_SECTOR);
+  bitmap_mark (fm->map, JOURNAL_SECTOR);
+  bitmap_mark (fm->map, REFCOUNT_SECTOR);
+  refcount_init (volume);
+  fm->dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (fm->map),
+                                               BITS_PER_SECTOR));
+  if (fm->dirty_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
-  bitmap_mark (free_map, FREE_MAP_SECTOR);
-  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  fm->group_cnt = DIV_ROUND_UP (bitmap_size (fm->map), GROUP_SECTORS);
+  fm->group_free = malloc (fm->group_cnt * sizeof *fm->group_free);
+  if (fm->group_free == NULL)
+    PANIC ("block group table allocation failed");
+  fm->align_skew = block_base_sector (device) % ALIGN_SECTORS;
+  fm->align_skew = (ALIGN_SECTORS - fm->align_skew) % ALIGN_SECTORS;
+  count_group_free (fm);
+  extent_tree_init (&fm->free_extents);
+  build_free_extents (fm);
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the root volume's free
+   map and stores the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.  The change reaches the free map file
+   at the next free_map_flush(). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Allocates CNT consecutive sectors from the free map of GOAL's
+   volume, as close after sector GOAL as possible, and stores the
+   first into *SECTORP.  Tries GOAL itself, then the rest of GOAL's
+   block group, then the following groups in turn, and finally any
+   sectors at all.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  int volume = sector_volume (goal);
+  struct free_map *fm = &free_maps[volume];
+  block_sector_t sector = BITMAP_ERROR;
+
+  goal = sector_offset (goal);
+  if (goal >= bitmap_size (fm->map))
+    goal = 0;
+
+  if (!fm->free_extents_valid)
+    {
+      sector = bitmap_scan_and_flip (fm->map, goal, cnt, false);
+      if (sector == BITMAP_ERROR)
+        sector = bitmap_scan_and_flip (fm->map, 0, cnt, false);
+    }
+  else
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      size_t group = goal / GROUP_SECTORS;
+      size_t i;
+
+      if (extent_tree_take_at (&fm->free_extents, goal, cnt))
+        sector = goal;
+      else if (!take_from_group (fm, group, goal, cnt, &sector))
+        {
+          for (i = 1; i < fm->group_cnt; i++)
+            {
+              size_t g = (group + i) % fm->group_cnt;
+              if (fm->group_free[g] >= cnt
+                  && take_from_group (fm, g, g * GROUP_SECTORS, cnt, &sector))
+                break;
+            }
+          if (i == fm->group_cnt
+              && !extent_tree_take (&fm->free_extents, cnt, &sector))
+            sector = BITMAP_ERROR;
+        }
+
+      if (sector != BITMAP_ERROR)
+        bitmap_set_multiple (fm->map, sector, cnt, true);
     }
+
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      adjust_group_free (fm, sector, cnt, true);
+      mark_dirty (fm, sector, cnt);
+      *sectorp = volume_sector (volume, sector);
+      journal_reuse (*sectorp, cnt);
+    }
   return sector != BITMAP_ERROR;
 }
 
-/* Allocates one sector from the free map and returns the sector's address.
-   If the operation failed, returns -1. */
+/* Allocates one sector from the root volume's free map and returns
+   the sector's address.  If the operation failed, returns -1. */
 block_sector_t
 free_map_allocate_one ()
+{
+  return free_map_allocate_one_near (0);
+}
+
+/* Allocates one sector from the free map of GOAL's volume, as close
+   after sector GOAL as possible, and returns the sector's address.
+   If the operation failed, returns -1. */
+block_sector_t
+free_map_allocate_one_near (block_sector_t goal)
 {
   block_sector_t new_alloc;
-  bool success = free_map_allocate (1, &new_alloc);
+  bool success = free_map_allocate_near (1, goal, &new_alloc);
   if (!success)
     return -1;
   return new_alloc;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.  A
+   sector that more than one file shares only loses a reference.
+   The change reaches the free map file at the next
+   free_map_flush(). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  int volume = sector_volume (sector);
+  struct free_map *fm = &free_maps[volume];
+
+  if (refcount_any (volume))
+    {
+      /* Release the runs of sectors that were not shared. */
+      size_t i, start = 0;
+      for (i = 0; i < cnt; i++)
+        if (refcount_drop (sector + i))
+          {
+            if (i > start)
+              release_run (fm, sector_offset (sector) + start, i - start);
+            start = i + 1;
+          }
+      if (cnt > start)
+        release_run (fm, sector_offset (sector) + start, cnt - start);
+    }
+  else
+    release_run (fm, sector_offset (sector), cnt);
+}
+
+/* Marks the CNT sectors starting at SECTOR free in FM. */
+static void
+release_run (struct free_map *fm, block_sector_t sector, size_t cnt)
+{
+  ASSERT (bitmap_all (fm->map, sector, cnt));
+  bitmap_set_multiple (fm->map, sector, cnt, false);
+  add_free_extent (fm, sector, cnt);
+  adjust_group_free (fm, sector, cnt, false);
+  mark_dirty (fm, sector, cnt);
+  journal_forget (volume_sector (fm - free_maps, sector), cnt);
+}
+
+/* Writes the sectors of each volume's free map file that have
+   changed since the last flush, merging runs of adjacent dirty
+   sectors into single writes.  Returns true if successful, false
+   if some sector could not be written; those remain dirty. */
+bool
+free_map_flush (void)
+{
+  bool success = true;
+  int volume;
+
+  /* The reference counts are written back along with the bits. */
+  if (!refcount_flush ())
+    success = false;
+
+  for (volume = 0; volume < VOLUME_MAX; volume++)
+    {
+      struct free_map *fm = &free_maps[volume];
+      size_t start = 0;
+
+      if (fm->file == NULL)
+        continue;
+
+      while ((start = bitmap_scan (fm->dirty_map, start, 1, true))
+             != BITMAP_ERROR)
+        {
+          size_t end = bitmap_scan (fm->dirty_map, start, 1, false);
+          size_t first_bit, bit_cnt;
+
+          if (end == BITMAP_ERROR)
+            end = bitmap_size (fm->dirty_map);
+          first_bit = start * BITS_PER_SECTOR;
+          bit_cnt = end * BITS_PER_SECTOR - first_bit;
+          if (bit_cnt > bitmap_size (fm->map) - first_bit)
+            bit_cnt = bitmap_size (fm->map) - first_bit;
+
+          if (bitmap_write_range (fm->map, fm->file, first_bit, bit_cnt))
+            {
+              bitmap_set_multiple (fm->dirty_map, start, end - start, false);
+              fm->dirty_cnt -= end - start;
+            }
+          else
+            success = false;
+          start = end;
+        }
+    }
+  return success;
+}
+
+/* Returns the number of sectors of VOLUME's free map and
+   reference count files that free_map_flush() would write. */
+size_t
+free_map_dirty_cnt (int volume)
+{
+  return free_maps[volume].dirty_cnt + refcount_dirty_cnt (volume);
+}
+
+/* Takes CNT consecutive free sectors of FM from an extent that
+   starts in block group GROUP at or after sector FROM, and stores
+   the first into *SECTORP.  Runs of ALIGN_SECTORS or more start on
+   an aligned sector if some extent has room for that.  Returns true
+   if successful. */
+static bool
+take_from_group (struct free_map *fm, size_t group, block_sector_t from,
+                 size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t to = (group + 1) * GROUP_SECTORS;
+
+  if (cnt >= ALIGN_SECTORS
+      && extent_tree_take_aligned (&fm->free_extents, cnt, ALIGN_SECTORS,
+                                   fm->align_skew, from, to, sectorp))
+    return true;
+  return extent_tree_take_within (&fm->free_extents, cnt, from, to, sectorp);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Recounts the free sectors in each block group of FM from its
+   bitmap. */
+static void
+count_group_free (struct free_map *fm)
+{
+  size_t g;
+
+  for (g = 0; g < fm->group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = bitmap_size (fm->map) - start;
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      fm->group_free[g] = bitmap_count (fm->map, start, cnt, false);
+    }
+}
+
+/* Updates FM's per-group free counts for the CNT sectors starting
+   at SECTOR, which have just been ALLOCATED or released. */
+static void
+adjust_group_free (struct free_map *fm, block_sector_t sector, size_t cnt,
+                   bool allocated)
+{
+  while (cnt > 0)
+    {
+      size_t g = sector / GROUP_SECTORS;
+      size_t n = (g + 1) * GROUP_SECTORS - sector;
+      if (n > cnt)
+        n = cnt;
+
+      if (allocated)
+        fm->group_free[g] -= n;
+      else
+        fm->group_free[g] += n;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Records that FM's bits for the CNT sectors starting at SECTOR
+   have changed. */
+static void
+mark_dirty (struct free_map *fm, block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  fm->dirty_cnt += bitmap_count (fm->dirty_map, first, last - first + 1,
+                                 false);
+  bitmap_set_multiple (fm->dirty_map, first, last - first + 1, true);
+}
+
+/* Rebuilds FM's free extent index from the free bits in its
+   bitmap. */
+static void
+build_free_extents (struct free_map *fm)
+{
+  size_t start = 0;
+
+  extent_tree_destroy (&fm->free_extents);
+  fm->free_extents_valid = true;
+  while ((start = bitmap_scan (fm->map, start, 1, false)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (fm->map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (fm->map);
+      add_free_extent (fm, start, end - start);
+      if (!fm->free_extents_valid)
+        return;
+      start = end;
+    }
+}
+
+/* Adds the CNT sectors starting at SECTOR, which have just been
+   marked free in FM's bitmap, to its free extent index. */
+static void
+add_free_extent (struct free_map *fm, block_sector_t sector, size_t cnt)
+{
+  if (fm->free_extents_valid
+      && !extent_tree_add (&fm->free_extents, sector, cnt))
+    {
+      printf ("free map: out of memory for extent index, "
+              "falling back to bitmap scans\n");
+      extent_tree_destroy (&fm->free_extents);
+      fm->free_extents_valid = false;
+    }
+}
+
+/* Opens VOLUME's free map file and reads it from disk. */
 void
-free_map_open (void) 
+free_map_open (int volume) 
 {
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR, false));
-  if (free_map_file == NULL)
+  struct free_map *fm = &free_maps[volume];
+
+  fm->file = file_open (inode_open (volume_sector (volume, FREE_MAP_SECTOR),
+                                    false));
+  if (fm->file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (fm->map, fm->file))
     PANIC ("can't read free map");
+  bitmap_set_all (fm->dirty_map, false);
+  fm->dirty_cnt = 0;
+  count_group_free (fm);
+  build_free_extents (fm);
+  refcount_open (volume);
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes VOLUME's free map to disk and closes its free map
+   file. */
 void
-free_map_close (void) 
+free_map_close (int volume) 
 {
-  file_close (free_map_file);
+  struct free_map *fm = &free_maps[volume];
+
+  refcount_close (volume);
+  if (!free_map_flush ())
+    printf ("free map: write-back failed\n");
+  file_close (fm->file);
+  fm->file = NULL;
 }
 
-/* Creates a new free map file on disk and writes the free map to
+/* Creates a new free map file on VOLUME and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (int volume) 
 {
+  struct free_map *fm = &free_maps[volume];
+  block_sector_t sector = volume_sector (volume, FREE_MAP_SECTOR);
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (sector, bitmap_file_size (fm->map)))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR, false));
-  if (free_map_file == NULL)
+  fm->file = file_open (inode_open (sector, false));
+  if (fm->file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (fm->map, fm->file))
     PANIC ("can't write free map");
+  bitmap_set_all (fm->dirty_map, false);
+  fm->dirty_cnt = 0;
+  refcount_create (volume);
 }
@@ -5,14 +5,18 @@
 #include <stddef.h>
 #include "devices/block.h"
 
-void free_map_init (void);
+void free_map_init (int volume);
 void free_map_read (void);
-void free_map_create (void);
-void free_map_open (void);
-void free_map_close (void);
+void free_map_create (int volume);
+void free_map_open (int volume);
+void free_map_close (int volume);
+bool free_map_flush (void);
+size_t free_map_dirty_cnt (int volume);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (size_t, block_sector_t goal, block_sector_t *);
 block_sector_t free_map_allocate_one (void);
+block_sector_t free_map_allocate_one_near (block_sector_t goal);
 void free_map_release (block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -11,6 +11,8 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+static void read_file (void *src, void *buffer, size_t size);
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -166,26 +168,46 @@ fsutil_extract (char **argv UNUSED)
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
-
   const char *file_name = argv[1];
-  void *buffer;
   struct file *src;
-  struct block *dst;
-  off_t size;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
-  /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
-  if (buffer == NULL)
-    PANIC ("couldn't allocate buffer");
-
   /* Open source file. */
   src = file_open (filesys_open (file_name));
   if (src == NULL)
     PANIC ("%s: open failed", file_name);
-  size = file_length (src);
+
+  fsutil_append_data (file_name, file_length (src), read_file, src);
+  file_close (src);
+}
+
+/* Reads SIZE bytes from SRC_, an open file, into BUFFER. */
+static void
+read_file (void *src_, void *buffer, size_t size)
+{
+  struct file *src = src_;
+  if (file_read (src, buffer, size) != (off_t) size)
+    PANIC ("read failed with %zu bytes unread", size);
+}
+
+/* Appends a file named FILE_NAME, SIZE bytes long, to the ustar
+   archive on the scratch device, at the same position used by
+   fsutil_append().  READ is called to produce the file's data, a
+   piece at a time, with AUX and a buffer to fill. */
+void
+fsutil_append_data (const char *file_name, off_t size,
+                    fsutil_read_func *read, void *aux)
+{
+  static block_sector_t sector = 0;
+
+  void *buffer;
+  struct block *dst;
+
+  /* Allocate buffer. */
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
 
   /* Open target block device. */
   dst = block_get_role (BLOCK_SCRATCH);
@@ -203,8 +225,7 @@ fsutil_append (char **argv)
       int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
       if (sector >= block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
-      if (file_read (src, buffer, chunk_size) != chunk_size)
-        PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
+      read (aux, buffer, chunk_size);
       memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
       block_write (dst, sector++, buffer);
       size -= chunk_size;
@@ -218,6 +239,5 @@ fsutil_append (char **argv)
   block_write (dst, sector, buffer + 1);
 
   /* Finish up. */
-  file_close (src);
   free (buffer);
 }
@@ -1,10 +1,19 @@
 #ifndef FILESYS_FSUTIL_H
 #define FILESYS_FSUTIL_H
 
+#include <stddef.h>
+#include "filesys/off_t.h"
+
 void fsutil_ls (char **argv);
 void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
 void fsutil_extract (char **argv);
 void fsutil_append (char **argv);
 
+/* Fills BUFFER with the next SIZE bytes of a file being appended
+   by fsutil_append_data(). */
+typedef void fsutil_read_func (void *aux, void *buffer, size_t size);
+void fsutil_append_data (const char *file_name, off_t size,
+                         fsutil_read_func *, void *aux);
+
 #endif /* filesys/fsutil.h */
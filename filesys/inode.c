@@ -1,4 +1,5 @@
 #include "filesys/inode.h"
+#include <bitmap.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -7,7 +8,12 @@
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/refcount.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 
 /* Global file descriptor counter. This begins counting at 3 because file
    descriptors 0, 1, and 2 are reserved for stdin, stdout, and stderr,
@@ -20,6 +26,19 @@ int fd_counter = 3;
 /* Number of addresses per block. */
 #define ADDRS_PER_BLOCK (BLOCK_SECTOR_SIZE / 4)
 
+/* Most sectors moved by one uncached disk request. */
+#define DIRECT_RUN_MAX 64
+
+/* Data sectors that a write or allocation maps before it lets the
+   journal commit the part done so far.  It does so sooner if the
+   journal runs short of room. */
+#define RESTART_SECTORS 64
+
+/* Data sectors released in one step of truncating or deleting a
+   file.  Each may dirty a free map sector and a reference count
+   sector, so a step stays well within JOURNAL_OP_MAX. */
+#define RELEASE_SECTORS 8
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -28,47 +47,462 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Returns true if INODE's contents are metadata: a directory, the
+   free map or the reference counts. */
+static inline bool
+is_metadata (const struct inode *inode)
+{
+  return (inode->isdir
+          || sector_offset (inode->sector) == FREE_MAP_SECTOR
+          || sector_offset (inode->sector) == REFCOUNT_SECTOR);
+}
+
+/* Returns entry OFS of index block SECTOR. */
+static block_sector_t
+index_get (block_sector_t sector, size_t ofs)
+{
+  int index = cache_lookup (sector);
+  block_sector_t entry = ((block_sector_t *) buffer_cache.cache[index].data)[ofs];
+  cache_operation_done (index);
+  return entry;
+}
+
+/* Sets entry OFS of index block SECTOR to ENTRY. */
+static void
+index_set (block_sector_t sector, size_t ofs, block_sector_t entry)
+{
+  int index = cache_lookup (sector);
+  ((block_sector_t *) buffer_cache.cache[index].data)[ofs] = entry;
+  buffer_cache.cache[index].dirty = true;
+  journal_dirty (index);
+  cache_operation_done (index);
+}
+
+/* Returns the sector that holds data sector IDX of the file whose
+   on-disk inode is DISK_INODE, or 0 if IDX is not mapped.  (Sector
+   0 holds the free map inode, so it is never a data sector.) */
+static block_sector_t
+lookup_sector (const struct inode_disk *disk_inode, size_t idx)
+{
+  block_sector_t indirect;
+
+  if (idx < DIRECT_BLOCKS)
+    return disk_inode->direct[idx];
+
+  idx -= DIRECT_BLOCKS;
+  if (idx < INDIRECT_BLOCKS * ADDRS_PER_BLOCK)
+    {
+      indirect = disk_inode->indirect[idx / ADDRS_PER_BLOCK];
+      return indirect != 0 ? index_get (indirect, idx % ADDRS_PER_BLOCK) : 0;
+    }
+
+  idx -= INDIRECT_BLOCKS * ADDRS_PER_BLOCK;
+  if (idx < ADDRS_PER_BLOCK * ADDRS_PER_BLOCK
+      && disk_inode->doubly_indirect != 0)
+    {
+      indirect = index_get (disk_inode->doubly_indirect,
+                            idx / ADDRS_PER_BLOCK);
+      return indirect != 0 ? index_get (indirect, idx % ADDRS_PER_BLOCK) : 0;
+    }
+  return 0;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
+   Returns 0 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
-  //  if (pos < inode->data.length)
-  //{
-      int direct_idx = pos / BLOCK_SECTOR_SIZE;
+  return lookup_sector (&inode->data, pos / BLOCK_SECTOR_SIZE);
+}
+
+/* Allocates a sector as close after *GOAL as the free map allows
+   and advances *GOAL past it, so that successive calls lay out a
+   file's blocks contiguously near its inode.
+   Returns the sector, or -1 if the disk is full. */
+static block_sector_t
+allocate_near (block_sector_t *goal)
+{
+  block_sector_t sector = free_map_allocate_one_near (*goal);
+  if (sector != (block_sector_t) -1)
+    *goal = sector + 1;
+  return sector;
+}
+
+/* Allocates a sector near *GOAL for an index block with no
+   entries.  Returns the sector, or 0 if the disk is full. */
+static block_sector_t
+new_index_block (block_sector_t *goal)
+{
+  static block_sector_t empty[ADDRS_PER_BLOCK];
+  block_sector_t sector = allocate_near (goal);
+
+  if (sector == (block_sector_t) -1)
+    return 0;
+  journal_write (sector, empty);
+  return sector;
+}
+
+/* Stores SECTOR in *SLOT, which must be empty, or if SECTOR is 0,
+   a sector allocated near *GOAL.  Returns the sector stored, or 0
+   if the disk is full. */
+static block_sector_t
+fill_slot (block_sector_t *slot, block_sector_t sector, block_sector_t *goal)
+{
+  if (sector == 0)
+    {
+      sector = allocate_near (goal);
+      if (sector == (block_sector_t) -1)
+        return 0;
+    }
+  *slot = sector;
+  return sector;
+}
+
+/* Like fill_slot(), for entry OFS of index block INDIRECT, but
+   leaves an entry that is already mapped as it is. */
+static block_sector_t
+fill_entry (block_sector_t indirect, size_t ofs, block_sector_t sector,
+            block_sector_t *goal)
+{
+  block_sector_t entry = index_get (indirect, ofs);
+
+  if (entry == 0 && fill_slot (&entry, sector, goal) != 0)
+    index_set (indirect, ofs, entry);
+  return entry;
+}
+
+/* Maps data sector IDX of the file whose on-disk inode is
+   DISK_INODE, if it is not mapped yet, to SECTOR, or if SECTOR is
+   0, to a newly allocated sector near *GOAL.  Allocates any index
+   blocks needed along the way near *GOAL as well.  The caller must
+   write DISK_INODE back.
+   Returns the sector that holds data sector IDX, or 0 if IDX is
+   beyond the largest possible file or the disk is full. */
+static block_sector_t
+map_sector (struct inode_disk *disk_inode, size_t idx, block_sector_t sector,
+            block_sector_t *goal)
+{
+  block_sector_t *indirect, dbl_entry;
+
+  if (idx < DIRECT_BLOCKS)
+    {
+      if (disk_inode->direct[idx] != 0)
+        return disk_inode->direct[idx];
+      return fill_slot (&disk_inode->direct[idx], sector, goal);
+    }
+
+  idx -= DIRECT_BLOCKS;
+  if (idx < INDIRECT_BLOCKS * ADDRS_PER_BLOCK)
+    {
+      indirect = &disk_inode->indirect[idx / ADDRS_PER_BLOCK];
+      if (*indirect == 0)
+        *indirect = new_index_block (goal);
+      if (*indirect == 0)
+        return 0;
+      return fill_entry (*indirect, idx % ADDRS_PER_BLOCK, sector, goal);
+    }
+
+  idx -= INDIRECT_BLOCKS * ADDRS_PER_BLOCK;
+  if (idx >= ADDRS_PER_BLOCK * ADDRS_PER_BLOCK)
+    return 0;
+  if (disk_inode->doubly_indirect == 0)
+    disk_inode->doubly_indirect = new_index_block (goal);
+  if (disk_inode->doubly_indirect == 0)
+    return 0;
+  dbl_entry = index_get (disk_inode->doubly_indirect, idx / ADDRS_PER_BLOCK);
+  if (dbl_entry == 0)
+    {
+      dbl_entry = new_index_block (goal);
+      if (dbl_entry == 0)
+        return 0;
+      index_set (disk_inode->doubly_indirect, idx / ADDRS_PER_BLOCK,
+                 dbl_entry);
+    }
+  return fill_entry (dbl_entry, idx % ADDRS_PER_BLOCK, sector, goal);
+}
+
+/* Changes data sector IDX of the file whose on-disk inode is
+   DISK_INODE, which must be mapped, to SECTOR.  The caller must
+   write DISK_INODE back. */
+static void
+remap_sector (struct inode_disk *disk_inode, size_t idx, block_sector_t sector)
+{
+  if (idx < DIRECT_BLOCKS)
+    {
+      disk_inode->direct[idx] = sector;
+      return;
+    }
+
+  idx -= DIRECT_BLOCKS;
+  if (idx < INDIRECT_BLOCKS * ADDRS_PER_BLOCK)
+    {
+      index_set (disk_inode->indirect[idx / ADDRS_PER_BLOCK],
+                 idx % ADDRS_PER_BLOCK, sector);
+      return;
+    }
+
+  idx -= INDIRECT_BLOCKS * ADDRS_PER_BLOCK;
+  index_set (index_get (disk_inode->doubly_indirect, idx / ADDRS_PER_BLOCK),
+             idx % ADDRS_PER_BLOCK, sector);
+}
 
-      if (direct_idx < DIRECT_BLOCKS)
-        return inode->data.direct[direct_idx];
+/* Returns a good place to put data sector IDX of INODE: just past
+   the sector that holds data sector IDX - 1, if that is mapped, or
+   else just past INODE itself. */
+static block_sector_t
+goal_for (const struct inode *inode, size_t idx)
+{
+  block_sector_t prev = idx > 0 ? lookup_sector (&inode->data, idx - 1) : 0;
+  return prev != 0 ? prev + 1 : inode->sector + 1;
+}
+
+/* Gives INODE a private copy of data sector IDX, currently SECTOR,
+   which it shares with other files, placing the copy near *GOAL.
+   Returns the copy's sector, or 0 if the disk is full. */
+static block_sector_t
+unshare_sector (struct inode *inode, size_t idx, block_sector_t sector,
+                block_sector_t *goal)
+{
+  block_sector_t copy = allocate_near (goal);
+  int from, to;
+
+  if (copy == (block_sector_t) -1)
+    return 0;
 
-      direct_idx -= DIRECT_BLOCKS;
-      int indirect_idx = direct_idx / ADDRS_PER_BLOCK;
-      int indirect_ofs = direct_idx % ADDRS_PER_BLOCK;
-      if (direct_idx < ADDRS_PER_BLOCK * INDIRECT_BLOCKS)
+  from = cache_lookup (sector);
+  to = cache_overwrite (copy, buffer_cache.cache[from].data);
+  buffer_cache.cache[to].dirty = true;
+  buffer_cache.cache[to].owner = inode->sector;
+  cache_operation_done (to);
+  cache_operation_done (from);
+
+  remap_sector (&inode->data, idx, copy);
+  free_map_release (sector, 1);
+  return copy;
+}
+
+/* Sectors waiting to be released to the free map.  Consecutive
+   sectors are gathered into a single run, so that freeing a file
+   laid out contiguously takes few free map updates. */
+struct release_run
+  {
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+  };
+
+/* Releases the sectors gathered in RUN and empties it. */
+static void
+release_flush (struct release_run *run)
+{
+  if (run->cnt > 0)
+    free_map_release (run->start, run->cnt);
+  run->cnt = 0;
+}
+
+/* Adds SECTOR to the sectors to be released by way of RUN. */
+static void
+release_sector (struct release_run *run, block_sector_t sector)
+{
+  if (run->cnt > 0 && sector == run->start + run->cnt)
+    run->cnt++;
+  else
+    {
+      release_flush (run);
+      run->start = sector;
+      run->cnt = 1;
+    }
+}
+
+/* Releases the data sectors mapped by entries FIRST and up of
+   index block INDIRECT by way of RUN.  If FIRST is 0, releases
+   INDIRECT itself too; otherwise, clears the released entries. */
+static void
+release_entries (block_sector_t indirect, size_t first,
+                 struct release_run *run)
+{
+  int index = cache_lookup (indirect);
+  block_sector_t *entries = (block_sector_t *) buffer_cache.cache[index].data;
+  bool changed = false;
+  size_t i;
+
+  for (i = first; i < ADDRS_PER_BLOCK; i++)
+    if (entries[i] != 0)
+      {
+        release_sector (run, entries[i]);
+        entries[i] = 0;
+        changed = true;
+      }
+  if (changed && first > 0)
+    {
+      buffer_cache.cache[index].dirty = true;
+      journal_dirty (index);
+    }
+  cache_operation_done (index);
+
+  if (first == 0)
+    release_sector (run, indirect);
+}
+
+/* Unmaps and releases data sectors KEEP and up of the file whose
+   on-disk inode is DISK_INODE, along with every index block left
+   with no entries.  Whole index blocks are dropped without being
+   rewritten.  The caller must write DISK_INODE back. */
+static void
+release_sectors (struct inode_disk *disk_inode, size_t keep)
+{
+  struct release_run run;
+  size_t i, base;
+
+  run.cnt = 0;
+
+  for (i = keep; i < DIRECT_BLOCKS; i++)
+    if (disk_inode->direct[i] != 0)
+      {
+        release_sector (&run, disk_inode->direct[i]);
+        disk_inode->direct[i] = 0;
+      }
+
+  base = DIRECT_BLOCKS;
+  for (i = 0; i < INDIRECT_BLOCKS; i++, base += ADDRS_PER_BLOCK)
+    if (disk_inode->indirect[i] != 0 && keep < base + ADDRS_PER_BLOCK)
+      {
+        size_t first = keep > base ? keep - base : 0;
+        release_entries (disk_inode->indirect[i], first, &run);
+        if (first == 0)
+          disk_inode->indirect[i] = 0;
+      }
+
+  if (disk_inode->doubly_indirect != 0)
+    {
+      size_t dbl_first = keep > base ? (keep - base) / ADDRS_PER_BLOCK : 0;
+      int index = cache_lookup (disk_inode->doubly_indirect);
+      block_sector_t *entries
+        = (block_sector_t *) buffer_cache.cache[index].data;
+
+      /* If the doubly indirect block itself goes, its entries are
+         left as they are. */
+      for (i = dbl_first; i < ADDRS_PER_BLOCK; i++)
+        if (entries[i] != 0)
+          {
+            size_t sub_base = base + i * ADDRS_PER_BLOCK;
+            size_t first = keep > sub_base ? keep - sub_base : 0;
+            release_entries (entries[i], first, &run);
+            if (first == 0 && keep > base)
+              {
+                entries[i] = 0;
+                buffer_cache.cache[index].dirty = true;
+                journal_dirty (index);
+              }
+          }
+      cache_operation_done (index);
+
+      if (keep <= base)
         {
-          block_sector_t *sector = malloc (BLOCK_SECTOR_SIZE);
-          block_read (fs_device, (block_sector_t) inode->data.indirect[indirect_idx], sector);
-          block_sector_t temp = *(sector + indirect_ofs);
-          free (sector);
-          return temp;
+          release_sector (&run, disk_inode->doubly_indirect);
+          disk_inode->doubly_indirect = 0;
         }
- 
-      direct_idx -= INDIRECT_BLOCKS * ADDRS_PER_BLOCK;
-      int dbl_indirect_idx = direct_idx / ADDRS_PER_BLOCK;
-      int dbl_indirect_ofs = direct_idx % ADDRS_PER_BLOCK;
-      block_sector_t **dbl_sector = malloc (BLOCK_SECTOR_SIZE);
-      block_read (fs_device, (block_sector_t) inode->data.doubly_indirect, dbl_sector);
-      block_sector_t *dbl_sector_ofs = malloc (BLOCK_SECTOR_SIZE);
-      block_read (fs_device, (block_sector_t) *(dbl_sector + dbl_indirect_idx), dbl_sector_ofs);
-      block_sector_t temp = *(dbl_sector_ofs + dbl_indirect_ofs);
-      free (dbl_sector);
-      free (dbl_sector_ofs);
-      return temp;
-      //}
-      //else
-      //return -1;
+    }
+
+  release_flush (&run);
+}
+
+/* Adds CNT to *SINCE, the number of data sectors written to,
+   allocated for or released from INODE by the operation in
+   progress, and once it reaches RESTART_SECTORS or the running
+   transaction is short of room, lets the journal commit the
+   operation so far and resets *SINCE.  Metadata files are written
+   from within other operations, so their writes are never split. */
+static void
+count_sectors (struct inode *inode, size_t *since, size_t cnt)
+{
+  *since += cnt;
+  if (!is_metadata (inode)
+      && (*since >= RESTART_SECTORS || !journal_has_room ()))
+    {
+      /* The block map goes along with the index blocks and free
+         map changes it refers to. */
+      journal_write (inode->sector, &inode->data);
+      journal_restart ();
+      *since = 0;
+    }
+}
+
+/* Returns the number of entries in use in index block INDIRECT,
+   counting up to the last nonzero one. */
+static size_t
+entries_used (block_sector_t indirect)
+{
+  int index = cache_lookup (indirect);
+  const block_sector_t *entries
+    = (const block_sector_t *) buffer_cache.cache[index].data;
+  size_t cnt = ADDRS_PER_BLOCK;
+
+  while (cnt > 0 && entries[cnt - 1] == 0)
+    cnt--;
+  cache_operation_done (index);
+  return cnt;
+}
+
+/* Returns one more than the index of the last data sector mapped
+   by DISK_INODE, or 0 if it maps none. */
+static size_t
+mapped_cnt (const struct inode_disk *disk_inode)
+{
+  size_t base = DIRECT_BLOCKS + INDIRECT_BLOCKS * ADDRS_PER_BLOCK;
+  size_t i, used;
+
+  if (disk_inode->doubly_indirect != 0)
+    for (i = ADDRS_PER_BLOCK; i-- > 0; )
+      {
+        block_sector_t indirect = index_get (disk_inode->doubly_indirect, i);
+        if (indirect != 0 && (used = entries_used (indirect)) > 0)
+          return base + i * ADDRS_PER_BLOCK + used;
+      }
+  for (i = INDIRECT_BLOCKS; i-- > 0; )
+    {
+      base -= ADDRS_PER_BLOCK;
+      if (disk_inode->indirect[i] != 0
+          && (used = entries_used (disk_inode->indirect[i])) > 0)
+        return base + used;
+    }
+  for (i = DIRECT_BLOCKS; i-- > 0; )
+    if (disk_inode->direct[i] != 0)
+      return i + 1;
+  return 0;
+}
+
+/* Releases data sectors KEEP and up of INODE, like
+   release_sectors(), but RELEASE_SECTORS at a time from the end of
+   the file, so that the journal can commit between steps.  A crash
+   in between leaves INODE mapping part of the tail, which is
+   harmless. */
+static void
+release_tail (struct inode *inode, size_t keep)
+{
+  size_t end, since = 0;
+
+  do
+    {
+      end = mapped_cnt (&inode->data);
+      end = end > keep + RELEASE_SECTORS ? end - RELEASE_SECTORS : keep;
+      release_sectors (&inode->data, end);
+      count_sectors (inode, &since, RELEASE_SECTORS);
+    }
+  while (end > keep);
+}
+
+/* Tells the journal that the operation in progress makes INODE
+   refer to data that may be dirty in the buffer cache, which must
+   then reach the disk before the operation commits.  The contents
+   of metadata files go through the journal instead. */
+static void
+order_data (struct inode *inode)
+{
+  if (!is_metadata (inode))
+    journal_data (inode->sector);
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -84,14 +518,17 @@ inode_init (void)
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is written empty first and then grown the
+   way a write past end of file grows it, with zeros, so that the
+   journal can commit a large file's blocks a piece at a time.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
 inode_create (block_sector_t sector, off_t length)
 {
   struct inode_disk *disk_inode = NULL;
-  bool success = false;
+  struct inode *inode;
+  bool success;
 
   ASSERT (length >= 0);
 
@@ -100,87 +537,21 @@ inode_create (block_sector_t sector, off_t length)
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
   disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
-    {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-
-      if (sectors > 0)
-        {
-          static char zeros[BLOCK_SECTOR_SIZE];
-
-          /* Direct blocks. */
-          unsigned i;
-          for (i = 0; i < sectors && i < DIRECT_BLOCKS; i++)
-            {
-              disk_inode->direct[i] = free_map_allocate_one ();
-              block_write (fs_device, disk_inode->direct[i], zeros);
-            }
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->magic = INODE_MAGIC;
+  journal_write (sector, disk_inode);
+  free (disk_inode);
+  if (length == 0)
+    return true;
 
-          /* Indirect blocks. */
-	  if (i == DIRECT_BLOCKS)
-            {
-              sectors -= i;
-              int j = -1;
-              for (i = 0;
-                   i < sectors && i < ADDRS_PER_BLOCK * INDIRECT_BLOCKS;
-                   i++)
-                {
-		  int ofs = i % ADDRS_PER_BLOCK;
-                  if (ofs == 0)
-                    {
-		      if (j >= 0)
-                        {
-                          block_sector_t *temp = disk_inode->indirect[j];
-                          disk_inode->indirect[j] = (block_sector_t *) free_map_allocate_one ();
-                          block_write (fs_device, (block_sector_t) disk_inode->indirect[j], temp);
-                          free (temp);
-                        }
-                      j++;
-                      disk_inode->indirect[j] = (block_sector_t *) calloc (1, BLOCK_SECTOR_SIZE);
-                    }
-                  *(disk_inode->indirect[j] + ofs) = free_map_allocate_one ();
-                  block_write (fs_device, *(disk_inode->indirect[j] + ofs),
-                               zeros);
-                }
-	      block_sector_t *temp = disk_inode->indirect[j];
-              disk_inode->indirect[j] = (block_sector_t *) free_map_allocate_one ();
-              block_write (fs_device, (block_sector_t) disk_inode->indirect[j], temp);
-              free (temp);
-	    }
-
-          /* Doubly indirect blocks. */
-	  disk_inode->doubly_indirect = (uint32_t ***) calloc (1, BLOCK_SECTOR_SIZE);
-	  if (i == ADDRS_PER_BLOCK * INDIRECT_BLOCKS)
-            {
-              sectors -= i;
-              int j;
-              int p;
-              for (j = 0; j < ADDRS_PER_BLOCK && i < sectors; j++)
-                {
-                  *(disk_inode->doubly_indirect + j) = (uint32_t **) calloc (1, BLOCK_SECTOR_SIZE);
-                  for (p = 0; p < ADDRS_PER_BLOCK && i < sectors; p++)
-                    {
-  		      *(*(*(disk_inode->doubly_indirect) + j) + p) = free_map_allocate_one ();
-                      block_write (fs_device, *(*(*(disk_inode->doubly_indirect) + j) + p), zeros);
-                      i++;
-                    }
-                  block_sector_t **temp = *(disk_inode->doubly_indirect + j);
-                  *(disk_inode->doubly_indirect + j) = (block_sector_t **) free_map_allocate_one ();
-                  block_write (fs_device, (block_sector_t) *(disk_inode->doubly_indirect + j), temp);
-                  free (temp);
-                }
-	    }
-          block_sector_t ***temp = disk_inode->doubly_indirect;
-          disk_inode->doubly_indirect = (block_sector_t ***) free_map_allocate_one ();
-          block_write (fs_device, (block_sector_t) disk_inode->doubly_indirect, temp);
-          free (temp);
-        }
-      block_write (fs_device, sector, disk_inode);
-      success = true;
-      free (disk_inode);
-    }
+  inode = inode_open (sector, false);
+  if (inode == NULL)
+    return false;
+  success = inode_truncate (inode, length);
+  if (!success)
+    inode_truncate (inode, 0);
+  inode_close (inode);
   return success;
 }
 
@@ -219,7 +590,10 @@ inode_open (block_sector_t sector, bool isdir)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->dir_slots = NULL;
+  inode->dir_entry_cnt = 0;
+  inode->dir_free_hint = 0;
+  cache_read (inode->sector, &inode->data);
   return inode;
 }
 
@@ -239,6 +613,37 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Stores the length, in bytes, of the inode stored in SECTOR into
+   *LENGTH, without opening it.  If the inode is already open, its
+   in-memory length is used, since it may not have been written
+   back yet.  Returns true if successful, false if memory
+   allocation fails. */
+bool
+inode_sector_length (block_sector_t sector, off_t *length)
+{
+  struct list_elem *e;
+  struct inode_disk *disk_inode;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        {
+          *length = inode_length (inode);
+          return true;
+        }
+    }
+
+  disk_inode = malloc (sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  cache_read (sector, disk_inode);
+  *length = disk_inode->length;
+  free (disk_inode);
+  return true;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -250,7 +655,7 @@ inode_close (struct inode *inode)
     return;
 
   //printf ("closing inode: length is %i\n", inode->data.length);
-  block_write (fs_device, inode->sector, &inode->data);
+  journal_write (inode->sector, &inode->data);
 
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
@@ -261,14 +666,12 @@ inode_close (struct inode *inode)
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          release_tail (inode, 0);
           free_map_release (inode->sector, 1);
-
-          size_t sectors = bytes_to_sectors (inode->data.length);
-          unsigned i;
-          for (i = 0; i < sectors; i++)
-            free_map_release (inode->data.direct[i], 1);
         }
 
+      if (inode->dir_slots != NULL)
+        bitmap_destroy (inode->dir_slots);
       free (inode); 
     }
 }
@@ -282,13 +685,190 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Position within an array of iovecs. */
+struct iov_pos
+  {
+    const struct iovec *iov;            /* Current iovec. */
+    int cnt;                            /* Iovecs left, including IOV. */
+    size_t ofs;                         /* Offset within IOV. */
+  };
+
+/* Returns the total length of the CNT iovecs in IOV. */
+static off_t
+iov_length (const struct iovec *iov, int cnt)
+{
+  off_t length = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    length += iov[i].iov_len;
+  return length;
+}
+
+/* Copies SIZE bytes between DATA and the iovecs at *POS, into DATA
+   if TO_DATA is true and out of DATA otherwise, and advances *POS
+   past them. */
+static void
+iov_copy (struct iov_pos *pos, uint8_t *data, size_t size, bool to_data)
+{
+  while (size > 0)
+    {
+      size_t n = pos->iov->iov_len - pos->ofs;
+      uint8_t *base = (uint8_t *) pos->iov->iov_base + pos->ofs;
+
+      if (n > size)
+        n = size;
+      if (to_data)
+        memcpy (data, base, n);
+      else
+        memcpy (base, data, n);
+      data += n;
+      size -= n;
+      pos->ofs += n;
+      if (pos->ofs == pos->iov->iov_len)
+        {
+          pos->iov++;
+          pos->cnt--;
+          pos->ofs = 0;
+        }
+    }
+}
+
+/* If the iovec at *POS has SIZE more bytes, returns a kernel
+   address for them, through which the disk can reach them even
+   while another process is running.  Otherwise, or if they are in
+   user memory and cross a page boundary, returns a null pointer.
+   Does not advance *POS. */
+static uint8_t *
+iov_span (const struct iov_pos *pos, size_t size)
+{
+  uint8_t *span;
+
+  if (pos->cnt == 0 || pos->iov->iov_len - pos->ofs < size)
+    return NULL;
+  span = (uint8_t *) pos->iov->iov_base + pos->ofs;
+  if (is_user_vaddr (span))
+    {
+      if (pg_ofs (span) + size > PGSIZE)
+        return NULL;
+      span = pagedir_get_page (thread_current ()->pagedir, span);
+    }
+  return span;
+}
+
+/* Advances *POS past SIZE bytes, which must all be in its current
+   iovec. */
+static void
+iov_skip (struct iov_pos *pos, size_t size)
+{
+  ASSERT (pos->iov->iov_len - pos->ofs >= size);
+  pos->ofs += size;
+  if (pos->ofs == pos->iov->iov_len)
+    {
+      pos->iov++;
+      pos->cnt--;
+      pos->ofs = 0;
+    }
+}
+
+/* Returns how many sectors of INODE can move in one uncached disk
+   request between the disk and kernel address SPAN, starting with
+   the sector at byte OFFSET, which is in disk sector SECTOR, is
+   uncached, and whose bytes are next at *POS.  Each later sector
+   must lie within the SIZE bytes left to transfer, follow the
+   previous one both on disk and in memory, and be neither cached
+   nor shared.  If GOAL is non-null, unmapped sectors are mapped
+   near *GOAL on the way, as a write needs.  Advances *POS past the
+   sectors. */
+static block_sector_t
+direct_run (struct inode *inode, struct iov_pos *pos, block_sector_t sector,
+            uint8_t *span, off_t offset, off_t size, block_sector_t *goal)
+{
+  block_sector_t cnt = 1;
+
+  iov_skip (pos, BLOCK_SECTOR_SIZE);
+  while (cnt < DIRECT_RUN_MAX
+         && (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= size)
+    {
+      size_t idx = offset / BLOCK_SECTOR_SIZE + cnt;
+      block_sector_t next;
+      int index;
+
+      if (iov_span (pos, BLOCK_SECTOR_SIZE) != span + cnt * BLOCK_SECTOR_SIZE)
+        break;
+      next = lookup_sector (&inode->data, idx);
+      if (next == 0 && goal != NULL)
+        {
+          if (*goal == 0)
+            *goal = goal_for (inode, idx);
+          next = map_sector (&inode->data, idx, 0, goal);
+        }
+      if (next != sector + cnt || refcount_is_shared (next))
+        break;
+      index = cache_find (next);
+      if (index != -1)
+        {
+          cache_operation_done (index);
+          break;
+        }
+
+      iov_skip (pos, BLOCK_SECTOR_SIZE);
+      cnt++;
+    }
+  return cnt;
+}
+
+static off_t readv_at (struct inode *, const struct iovec *, int, off_t,
+                       bool direct);
+static off_t writev_at (struct inode *, const struct iovec *, int, off_t,
+                        bool direct);
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
 {
-  uint8_t *buffer = buffer_;
+  struct iovec iov;
+
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  return inode_readv (inode, &iov, 1, offset);
+}
+
+/* Reads from INODE, starting at position OFFSET, into the IOV_CNT
+   buffers in IOV, filling each before moving on to the next.  Each
+   sector is copied out of the buffer cache once, however many
+   buffers it is split across.
+   Returns the number of bytes actually read, which may be less
+   than the buffers' total size if an error occurs or end of file is
+   reached. */
+off_t
+inode_readv (struct inode *inode, const struct iovec *iov, int iov_cnt,
+             off_t offset)
+{
+  return readv_at (inode, iov, iov_cnt, offset, false);
+}
+
+/* Like inode_readv(), but whole sectors that land in one buffer
+   are read from disk straight into the buffer, without going
+   through or displacing the buffer cache.  Partial sectors, and
+   sectors that are already cached, are still read from the cache,
+   since it may hold newer data than the disk. */
+off_t
+inode_readv_direct (struct inode *inode, const struct iovec *iov,
+                    int iov_cnt, off_t offset)
+{
+  return readv_at (inode, iov, iov_cnt, offset, true);
+}
+
+/* Implements inode_readv() and, if DIRECT, inode_readv_direct(). */
+static off_t
+readv_at (struct inode *inode, const struct iovec *iov, int iov_cnt,
+          off_t offset, bool direct)
+{
+  struct iov_pos pos = { iov, iov_cnt, 0 };
+  off_t size = iov_length (iov, iov_cnt);
   off_t bytes_read = 0;
 
   while (size > 0) 
@@ -307,20 +887,32 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      int index = cache_lookup (sector_idx);
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      uint8_t *span = NULL;
+      if (direct && chunk_size == BLOCK_SECTOR_SIZE)
+        span = iov_span (&pos, BLOCK_SECTOR_SIZE);
+      int index = (span != NULL ? cache_find (sector_idx)
+                   : cache_lookup (sector_idx));
+      if (index == -1)
         {
-          /* Copy a full sector from buffer cache. */
-          memcpy (buffer + bytes_read, buffer_cache.cache[index].data,
-	          chunk_size);
-	}
-      else 
+          block_sector_t cnt = direct_run (inode, &pos, sector_idx, span,
+                                           offset, (size < inode_left
+                                                    ? size : inode_left),
+                                           NULL);
+          volume_read_range (sector_idx, cnt, span);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
+        }
+      else
         {
-          /* Copy a partial sector from buffer cache. */
-          memcpy (buffer + bytes_read,
-	          buffer_cache.cache[index].data + sector_ofs, chunk_size);
-	  }
-      cache_operation_done (index);
+          if (span != NULL)
+            {
+              memcpy (span, buffer_cache.cache[index].data, BLOCK_SECTOR_SIZE);
+              iov_skip (&pos, BLOCK_SECTOR_SIZE);
+            }
+          else
+            iov_copy (&pos, buffer_cache.cache[index].data + sector_ofs,
+                      chunk_size, false);
+          cache_operation_done (index);
+        }
       
       /* Advance. */
       size -= chunk_size;
@@ -333,128 +925,381 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full, the file reaches its largest
+   possible size, or an error occurs.  A write past end of file
+   extends the inode, filling any gap with zeros. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
                 off_t offset) 
 {
-  int left = bytes_to_sectors (inode->data.length) * BLOCK_SECTOR_SIZE - offset;
-  const uint8_t *buffer = buffer_;
+  struct iovec iov;
+
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size;
+  return inode_writev (inode, &iov, 1, offset);
+}
+
+/* Writes the IOV_CNT buffers in IOV, one after another, into INODE,
+   starting at OFFSET.  Each sector is copied into the buffer cache
+   once, however many buffers it is split across.
+   Returns the number of bytes actually written, as for
+   inode_write_at(). */
+off_t
+inode_writev (struct inode *inode, const struct iovec *iov, int iov_cnt,
+              off_t offset)
+{
+  return writev_at (inode, iov, iov_cnt, offset, false);
+}
+
+/* Like inode_writev(), but whole sectors that come from one buffer
+   and are not cached are written straight from the buffer to disk,
+   without going through or displacing the buffer cache.  Partial
+   sectors, and sectors that are already cached, are still written
+   to the cache, to keep it coherent with the disk. */
+off_t
+inode_writev_direct (struct inode *inode, const struct iovec *iov,
+                     int iov_cnt, off_t offset)
+{
+  return writev_at (inode, iov, iov_cnt, offset, true);
+}
+
+/* Implements inode_writev() and, if DIRECT, inode_writev_direct(). */
+static off_t
+writev_at (struct inode *inode, const struct iovec *iov, int iov_cnt,
+           off_t offset, bool direct)
+{
+  struct iov_pos pos = { iov, iov_cnt, 0 };
+  off_t size = iov_length (iov, iov_cnt);
   off_t bytes_written = 0;
+  block_sector_t goal = 0;       /* Where to put new blocks, once known. */
+  size_t since = 0;              /* Sectors since the journal restart. */
 
   if (inode->deny_write_cnt)
     return 0;
 
+  /* Bytes past end of file are undefined, even in sectors that are
+     already mapped, so zero any gap up to OFFSET first. */
+  while (inode->data.length < offset)
+    {
+      static char zeros[BLOCK_SECTOR_SIZE];
+      off_t gap = offset - inode->data.length;
+      if (gap > BLOCK_SECTOR_SIZE)
+        gap = BLOCK_SECTOR_SIZE;
+      if (inode_write_at (inode, zeros, gap, inode->data.length) != gap)
+        return 0;
+      count_sectors (inode, &since, 1);
+    }
+
   while (size > 0) 
     {
-      if (left <= 0)
+      /* Sector to write, starting byte offset within sector.
+         Maps the sector first if this is the first write to it. */
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx = lookup_sector (&inode->data, idx);
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      if (sector_idx == 0)
         {
-          struct inode_disk disk_inode = inode->data;
-          static char zeros[BLOCK_SECTOR_SIZE];
-          size_t num_sectors = bytes_to_sectors (inode->data.length);
-          if (num_sectors < DIRECT_BLOCKS)
-            {
-              inode->data.direct[num_sectors] = free_map_allocate_one ();
-              block_write (fs_device, inode->data.direct[num_sectors], zeros);
-            }
-          else
-            {
-              num_sectors -= DIRECT_BLOCKS;
-	      int indirect_idx = num_sectors / ADDRS_PER_BLOCK;
-              int indirect_ofs = num_sectors % ADDRS_PER_BLOCK;
-              if (indirect_idx < INDIRECT_BLOCKS)
-                {
-                  if (indirect_ofs == 0)
-                    {
-                      // We need to allocate a new indirect block
-                      disk_inode.indirect[indirect_idx] = (block_sector_t *) free_map_allocate_one ();
-                    }
-                  // Then make a new indirect entry
-                  block_sector_t *sector = malloc (BLOCK_SECTOR_SIZE);
-                  block_read (fs_device, (block_sector_t) disk_inode.indirect[indirect_idx], sector);
-                  *(sector + indirect_ofs) = free_map_allocate_one ();
-                  block_write (fs_device, *(sector + indirect_ofs), zeros);
-                  block_write (fs_device, (block_sector_t) disk_inode.indirect[indirect_idx], sector);
-                  free (sector);
-                }
-              else
-                {
-                  num_sectors -= ADDRS_PER_BLOCK * INDIRECT_BLOCKS;
-                  int dbl_indirect_idx = num_sectors / ADDRS_PER_BLOCK;
-                  int dbl_indirect_ofs = num_sectors % ADDRS_PER_BLOCK;
-                  // Then make a new doubly indirect entry
-                  if (dbl_indirect_idx == 0 && dbl_indirect_ofs == 0)
-                    {
-                      // We need to allocate the double indirect block
-                      disk_inode.doubly_indirect = (block_sector_t ***) free_map_allocate_one ();
-                    }
-                  if (dbl_indirect_ofs == 0)
-                    {
-                      // We need to allocate a new indirect block
-                      block_sector_t **dbl_sector = malloc (BLOCK_SECTOR_SIZE);
-                      block_read (fs_device, (block_sector_t) inode->data.doubly_indirect, dbl_sector);
-                      *(dbl_sector + dbl_indirect_idx) = (block_sector_t *) free_map_allocate_one ();
-                      block_write (fs_device, (block_sector_t) inode->data.doubly_indirect, dbl_sector);
-                      free (dbl_sector);
-                    }
-                  //Then make a new indirect entry
-                  block_sector_t **dbl_sector = malloc (BLOCK_SECTOR_SIZE);
-                  block_read (fs_device, (block_sector_t) inode->data.doubly_indirect, dbl_sector);
-                  block_sector_t *dbl_sector_ofs = malloc (BLOCK_SECTOR_SIZE);
-                  block_read (fs_device, (block_sector_t) *(dbl_sector + dbl_indirect_idx), dbl_sector_ofs);
-                  *(dbl_sector_ofs + dbl_indirect_ofs) = free_map_allocate_one ();
-                  block_write (fs_device, *(dbl_sector_ofs + dbl_indirect_ofs), zeros);
-                  block_write (fs_device, (block_sector_t) *(dbl_sector + dbl_indirect_idx), dbl_sector_ofs);
-                  free (dbl_sector);
-                  free (dbl_sector_ofs);
-                }
-            }
-          left += BLOCK_SECTOR_SIZE;
+          if (goal == 0)
+            goal = goal_for (inode, idx);
+          sector_idx = map_sector (&inode->data, idx, 0, &goal);
+          if (sector_idx == 0)
+            break;
+          order_data (inode);
+        }
+      else if (refcount_is_shared (sector_idx))
+        {
+          /* Copy on write. */
+          if (goal == 0)
+            goal = goal_for (inode, idx);
+          sector_idx = unshare_sector (inode, idx, sector_idx, &goal);
+          if (sector_idx == 0)
+            break;
+          order_data (inode);
         }
 
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = left;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      /* Bytes left in sector. */
+      int min_left = BLOCK_SECTOR_SIZE - sector_ofs;
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (inode->data.length < offset + chunk_size)
-        inode->data.length = offset + chunk_size;
-      if (chunk_size <= 0)
-        break;
+        {
+          /* The new length exposes the sector, which may have been
+             reserved by inode_allocate() and never written. */
+          inode->data.length = offset + chunk_size;
+          order_data (inode);
+        }
 
-      int index = cache_lookup (sector_idx);
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* A whole sector in one piece of memory overwrites the
+         cached sector without reading it, or bypasses the cache in
+         direct mode. */
+      uint8_t *span = NULL;
+      if (chunk_size == BLOCK_SECTOR_SIZE)
+        span = iov_span (&pos, BLOCK_SECTOR_SIZE);
+      int index;
+      if (span == NULL)
+        index = cache_lookup (sector_idx);
+      else if (direct)
+        index = cache_find (sector_idx);
+      else
+        index = cache_overwrite (sector_idx, span);
+      if (index == -1)
         {
-          /* Write a full sector to buffer cache. */
-          memcpy (buffer_cache.cache[index].data, buffer + bytes_written,
-	          chunk_size);
+          block_sector_t cnt = direct_run (inode, &pos, sector_idx, span,
+                                           offset, size, &goal);
+          volume_write_range (sector_idx, cnt, span);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
+          if (inode->data.length < offset + chunk_size)
+            inode->data.length = offset + chunk_size;
         }
-      else 
+      else
         {
-          /* Write partial sector to buffer cache. */
-          memcpy (buffer_cache.cache[index].data + sector_ofs,
-                  buffer + bytes_written, chunk_size);
+          if (span != NULL)
+            {
+              if (direct)
+                memcpy (buffer_cache.cache[index].data, span,
+                        BLOCK_SECTOR_SIZE);
+              iov_skip (&pos, BLOCK_SECTOR_SIZE);
+            }
+          else
+            iov_copy (&pos, buffer_cache.cache[index].data + sector_ofs,
+                      chunk_size, true);
+          buffer_cache.cache[index].dirty = true;
+          buffer_cache.cache[index].owner = inode->sector;
+
+          /* Directory entries, the free map and the reference
+             counts are metadata, so their contents go through the
+             journal; ordinary file data does not. */
+          if (is_metadata (inode))
+            journal_dirty (index);
+          cache_operation_done (index);
         }
-      cache_operation_done (index);
 
       /* Advance. */
-      left -= chunk_size;
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
+      count_sectors (inode, &since, bytes_to_sectors (chunk_size));
     }
 
   return bytes_written;
 }
 
+/* Copies up to SIZE bytes of SRC, starting at SRC_OFS, into DST,
+   starting at DST_OFS.  Data moves straight from SRC's buffer cache
+   entries into DST's, and the part of DST being written is
+   allocated up front, contiguously if possible.  The two ranges
+   must not overlap.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if end of SRC is reached or DST cannot grow. */
+off_t
+inode_copy_at (struct inode *dst, off_t dst_ofs,
+               struct inode *src, off_t src_ofs, off_t size)
+{
+  off_t bytes_copied = 0;
+  size_t since = 0;
+
+  if (src_ofs >= inode_length (src) || size <= 0)
+    return 0;
+  if (size > inode_length (src) - src_ofs)
+    size = inode_length (src) - src_ofs;
+  if (dst->deny_write_cnt)
+    return 0;
+
+  /* A failure here shows up as a short write below. */
+  inode_allocate (dst, dst_ofs, size);
+
+  while (size > 0)
+    {
+      block_sector_t sector_idx = byte_to_sector (src, src_ofs);
+      int sector_ofs = src_ofs % BLOCK_SECTOR_SIZE;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+
+      int index = cache_lookup (sector_idx);
+      off_t written = inode_write_at (dst,
+                                      buffer_cache.cache[index].data
+                                      + sector_ofs,
+                                      chunk_size, dst_ofs);
+      cache_operation_done (index);
+
+      size -= written;
+      src_ofs += written;
+      dst_ofs += written;
+      bytes_copied += written;
+      if (written != chunk_size)
+        break;
+      count_sectors (dst, &since, 1);
+    }
+
+  return bytes_copied;
+}
+
+/* Makes DST, which must have no data sectors, a copy of SRC that
+   shares SRC's data sectors.  Each shared sector gains a
+   reference, and is copied when either file writes to it, so no
+   data is read or written here.  DST gets its own index blocks.
+   The sectors are shared one at a time, and the journal may commit
+   every RESTART_SECTORS of them; DST's length is set only at the
+   end, so a crash partway through leaves an empty DST with some of
+   SRC's sectors reserved for it.
+   Returns true if successful, false if memory or disk space runs
+   out or if DST and SRC are on different volumes. */
+bool
+inode_clone (struct inode *dst, struct inode *src)
+{
+  size_t idx, cnt = bytes_to_sectors (src->data.length), since = 0;
+  block_sector_t goal = dst->sector + 1;
+
+  if (sector_volume (dst->sector) != sector_volume (src->sector))
+    return false;
+
+  /* DST will refer to SRC's data as it is in the cache. */
+  order_data (src);
+
+  for (idx = 0; idx < cnt; idx++)
+    {
+      block_sector_t sector = lookup_sector (&src->data, idx);
+      if (!refcount_share (sector))
+        return false;
+      if (map_sector (&dst->data, idx, sector, &goal) != sector)
+        {
+          free_map_release (sector, 1);
+          return false;
+        }
+      count_sectors (dst, &since, 1);
+    }
+
+  dst->data.length = src->data.length;
+  journal_write (dst->sector, &dst->data);
+  return true;
+}
+
+static bool allocate_range (struct inode *, size_t first, size_t last,
+                            size_t *since);
+
+/* Reserves disk space for the LEN bytes of INODE starting at
+   OFFSET, so that writing them later only has to copy data.  The
+   sectors not yet mapped are allocated in contiguous runs of up to
+   RESTART_SECTORS, each as close after the one before as the disk
+   allows, and committed one run at a time.  They are not zeroed
+   and the length of INODE does not change.
+   Returns true if successful, false if the range is beyond the
+   largest possible file or the disk is full; in that case some of
+   the range may have been allocated anyway. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t len)
+{
+  size_t first, last, since = 0;
+
+  ASSERT (offset >= 0 && len >= 0);
+
+  if (len == 0)
+    return true;
+  last = (offset + len - 1) / BLOCK_SECTOR_SIZE;
+  for (first = offset / BLOCK_SECTOR_SIZE; first <= last;
+       first += RESTART_SECTORS)
+    {
+      size_t end = last - first < RESTART_SECTORS
+                   ? last : first + RESTART_SECTORS - 1;
+      if (!allocate_range (inode, first, end, &since))
+        return false;
+    }
+  return true;
+}
+
+/* Allocates and maps the data sectors FIRST through LAST of INODE
+   that are not mapped yet, as one contiguous run right after the
+   sector before them if possible.  Index blocks go after the run.
+   Otherwise the sectors are allocated one by one, possibly
+   scattered over many free map sectors, and counted one by one
+   with count_sectors().  *SINCE is as for count_sectors().
+   Returns true if successful, false if the range is beyond the
+   largest possible file or the disk is full. */
+static bool
+allocate_range (struct inode *inode, size_t first, size_t last,
+                size_t *since)
+{
+  size_t idx, cnt = 0;
+  block_sector_t run = 0, goal;
+
+  for (idx = first; idx <= last; idx++)
+    if (lookup_sector (&inode->data, idx) == 0)
+      cnt++;
+  if (cnt == 0)
+    return true;
+  goal = goal_for (inode, first);
+  if (free_map_allocate_near (cnt, goal, &run))
+    goal = run + cnt;
+  else
+    run = 0;
+
+  for (idx = first; idx <= last; idx++)
+    if (lookup_sector (&inode->data, idx) == 0)
+      {
+        if (map_sector (&inode->data, idx, run, &goal) == 0)
+          {
+            /* Return the part of the run that was not used. */
+            if (run != 0)
+              free_map_release (run, cnt);
+            return false;
+          }
+        if (run != 0)
+          {
+            run++;
+            cnt--;
+          }
+        else
+          count_sectors (inode, since, 1);
+      }
+  if (run != 0)
+    count_sectors (inode, since, last - first + 1);
+  return true;
+}
+
+/* Sets the length of INODE to LENGTH bytes.  Shrinking INODE
+   releases every data sector past the new end of file, including
+   any reserved by inode_allocate(); growing it fills the new bytes
+   with zeros.
+   Returns true if successful, false if the disk is full or LENGTH
+   is beyond the largest possible file. */
+bool
+inode_truncate (struct inode *inode, off_t length)
+{
+  ASSERT (length >= 0);
+
+  if (inode->deny_write_cnt)
+    return false;
+
+  if (length > inode->data.length)
+    inode_write_at (inode, NULL, 0, length);
+  else
+    {
+      /* Shorten the file first, so that a crash partway leaves the
+         rest of the tail merely reserved. */
+      inode->data.length = length;
+      release_tail (inode, bytes_to_sectors (length));
+    }
+
+  /* The new block map must reach the disk together with the free
+     map changes. */
+  journal_write (inode->sector, &inode->data);
+  return inode->data.length == length;
+}
+
+/* Makes INODE durable.  Writes its dirty data sectors to disk
+   first, then commits its inode sector and index blocks, which
+   refer to them.  The commit also writes the data of the other
+   files that the running transaction has mapped sectors for or
+   extended, but leaves other files' data in the cache. */
+void
+inode_sync (struct inode *inode)
+{
+  cache_write_back_owner (inode->sector);
+  journal_write (inode->sector, &inode->data);
+  journal_sync ();
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
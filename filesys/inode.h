@@ -2,6 +2,7 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <iovec.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 #include "lib/kernel/hash.h"
@@ -14,14 +15,16 @@
 #define INDIRECT_BLOCKS 25
 
 /* On-disk inode.   
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */        
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   A block pointer of 0 means that the block is not allocated.
+   Data sectors may be allocated past the end of file. */        
 struct inode_disk   
   {
     off_t length;                            /* File size in bytes. */
     unsigned magic;                          /* Magic number. */
     block_sector_t direct[DIRECT_BLOCKS];    /* Direct blocks. */
-    block_sector_t *indirect[INDIRECT_BLOCKS];     /* Indirect block. */
-    block_sector_t ***doubly_indirect;             /* Doubly indirect block. */
+    block_sector_t indirect[INDIRECT_BLOCKS];      /* Indirect blocks. */
+    block_sector_t doubly_indirect;                /* Doubly indirect block. */
   };
 
 /* In-memory inode. */
@@ -38,6 +41,13 @@ struct inode
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
     void *object;
+
+    /* Owned by filesys/directory.c; only meaningful for directories. */
+    struct bitmap *dir_slots;           /* In-use entry slots, or NULL if
+                                           not yet scanned. */
+    size_t dir_entry_cnt;               /* Number of live entries. */
+    size_t dir_free_hint;               /* No slot before this one is
+                                           free. */
   };
 
 struct bitmap;
@@ -51,8 +61,23 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readv (struct inode *, const struct iovec *, int iov_cnt,
+                   off_t offset);
+off_t inode_writev (struct inode *, const struct iovec *, int iov_cnt,
+                    off_t offset);
+off_t inode_readv_direct (struct inode *, const struct iovec *, int iov_cnt,
+                          off_t offset);
+off_t inode_writev_direct (struct inode *, const struct iovec *, int iov_cnt,
+                           off_t offset);
+off_t inode_copy_at (struct inode *dst, off_t dst_ofs,
+                     struct inode *src, off_t src_ofs, off_t size);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_sync (struct inode *);
+bool inode_allocate (struct inode *, off_t offset, off_t len);
+bool inode_truncate (struct inode *, off_t length);
+bool inode_clone (struct inode *dst, struct inode *src);
 off_t inode_length (const struct inode *);
+bool inode_sector_length (block_sector_t, off_t *);
 
 #endif /* filesys/inode.h */
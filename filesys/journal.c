@@ -0,0 +1,592 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+
+/* Metadata journal.
+
+   Updates to file system metadata -- inodes, index blocks,
+   directory contents and the free map -- are grouped into
+   transactions.  A transaction is committed by appending a copy of
+   every sector it modified to a log on disk, followed by a commit
+   record.  Until then, the modified sectors stay pinned in the
+   buffer cache, so that none of them can reach its home location
+   before the log does.  After a crash, journal_open() copies each
+   fully committed transaction in the log to its home location,
+   so that each operation's metadata updates appear on disk either
+   completely or not at all.
+
+   Committing every operation separately would cost two extra
+   writes per operation, so operations are batched: each one runs
+   between journal_begin() and journal_end(), and the running
+   transaction is committed only once it has grown large enough and
+   no operation is in progress (group commit).  A transaction is
+   never committed partway through an operation, so
+   journal_begin() first makes room in it for the largest one,
+   JOURNAL_OP_MAX sectors; longer operations, such as big writes,
+   end and restart themselves with journal_restart() at points
+   where their updates so far are consistent, checking
+   journal_has_room() between steps.  Free map and reference count
+   changes join the transaction only when the operation ends, so
+   the room counted includes them.
+
+   The log is a fixed region of the disk, described by a header in
+   JOURNAL_SECTOR.  Each transaction occupies a descriptor sector
+   listing the home sectors of the copies that follow it, the copies
+   themselves, and a commit sector.  When the log fills up, all
+   dirty sectors in the buffer cache are written home and the log
+   starts over (checkpoint).
+
+   File data is not logged, but a block map or file length in the
+   log must not expose data sectors whose contents never reached
+   the disk.  Operations that make a file refer to data that may be
+   dirty in the buffer cache report the file with journal_data(),
+   and a commit first writes back the data of those files only, so
+   that syncing one file does not write back every other file's
+   data too.
+
+   A metadata sector may be freed and reused for file data, which
+   is not logged, while an old copy of it is still in the log.
+   Replay would then overwrite the data with the stale copy, so
+   the log is checkpointed before such a sector is reused.
+
+   Each volume has its own log, holding only that volume's sectors,
+   and its header records the volume's number.  Operations never
+   span volumes, so a commit writes each volume's part of the
+   running transaction to that volume's log. */
+
+/* Identifies the journal header, descriptors and commit records. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x44455343
+#define COMMIT_MAGIC 0x434d4954
+
+/* Number of sectors in the log. */
+#define JOURNAL_SECTORS 256
+
+/* Maximum number of sectors in one transaction. */
+#define DESC_CNT 125
+
+/* Once the running transaction has modified this many sectors, it
+   is committed when the last operation in progress ends. */
+#define GROUP_COMMIT_CNT 16
+
+/* Most files whose data the running transaction tracks one by
+   one.  Past that, a commit writes back the data of every file. */
+#define DATA_OWNER_MAX 16
+
+/* Most sectors the running transaction may modify on one volume.
+   Each stays pinned in the volume's part of the buffer cache until
+   the commit, so this must leave room there for other sectors. */
+#define TXN_MAX_CNT (BUFFER_CACHE_SIZE - 8)
+
+/* On-disk journal header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    block_sector_t start;               /* First sector of the log. */
+    block_sector_t size;                /* Number of sectors in the log. */
+    uint32_t seq;                       /* Sequence number of the first
+                                           transaction in the log. */
+    uint32_t volume;                    /* Volume number. */
+    uint32_t unused[123];               /* Not used. */
+  };
+
+/* Transaction descriptor.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_desc
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[DESC_CNT];   /* Home sectors of the copies. */
+  };
+
+/* Transaction commit record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_commit
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t unused[126];               /* Not used. */
+  };
+
+/* A volume's journal. */
+struct journal
+  {
+    bool enabled;                       /* Whether updates are logged. */
+    struct journal_header header;       /* Copy of the on-disk header. */
+    block_sector_t head;                /* Next free sector in the log,
+                                           relative to header.start. */
+    uint32_t seq;                       /* Running transaction's number. */
+    struct bitmap *logged;              /* Sectors with copies in the
+                                           log, by offset in the
+                                           volume. */
+
+    /* The volume's part of the running transaction. */
+    block_sector_t txn[DESC_CNT];       /* Sectors it has modified. */
+    size_t txn_cnt;                     /* Number of sectors in TXN. */
+  };
+
+static struct journal journals[VOLUME_MAX];
+
+/* The running transaction. */
+static int handle_cnt;                  /* Operations in progress. */
+static bool committing;                 /* Whether it is being committed. */
+
+/* Inode sectors of the files whose data the running transaction
+   exposes, or all files if DATA_OVERFLOW. */
+static block_sector_t data_owners[DATA_OWNER_MAX];
+static size_t data_owner_cnt;
+static bool data_overflow;
+
+/* Buffers for writing and replaying the log. */
+static struct journal_desc desc;
+static struct journal_commit commit;
+static uint8_t copy[BLOCK_SECTOR_SIZE];
+
+static bool any_enabled (void);
+static void write_back_data (void);
+static void commit_volume (struct journal *);
+static void replay (struct journal *);
+static void checkpoint (struct journal *);
+static void write_header (struct journal *);
+
+/* Creates an empty journal on VOLUME and records its location and
+   the volume number in the journal header.  Must be called after
+   the volume's free map has been created. */
+void
+journal_create (int volume)
+{
+  struct journal *j = &journals[volume];
+
+  ASSERT (sizeof j->header == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof desc == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof commit == BLOCK_SECTOR_SIZE);
+
+  memset (&j->header, 0, sizeof j->header);
+  j->header.magic = JOURNAL_MAGIC;
+  j->header.size = JOURNAL_SECTORS;
+  j->header.volume = volume;
+  if (!free_map_allocate_near (JOURNAL_SECTORS, volume_sector (volume, 0),
+                               &j->header.start))
+    PANIC ("journal creation failed--disk is too large");
+  write_header (j);
+}
+
+/* Replays any transactions committed to VOLUME's journal but not
+   yet written to their home locations, then starts logging the
+   volume's metadata updates.  If the volume has no journal,
+   updates are not logged. */
+void
+journal_open (int volume)
+{
+  struct journal *j = &journals[volume];
+
+  volume_read (volume_sector (volume, JOURNAL_SECTOR), &j->header);
+  if (j->header.magic != JOURNAL_MAGIC)
+    {
+      printf ("journal: not found, metadata updates will not be logged\n");
+      return;
+    }
+
+  replay (j);
+  j->logged = bitmap_create (block_size (volume_device (volume)));
+  if (j->logged == NULL)
+    PANIC ("journal: bitmap creation failed");
+  j->txn_cnt = 0;
+  j->enabled = true;
+}
+
+/* Commits the running transaction and writes all metadata to its
+   home location, leaving every volume's journal empty. */
+void
+journal_close (void)
+{
+  int i;
+
+  journal_commit ();
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (journals[i].enabled)
+      {
+        checkpoint (&journals[i]);
+        bitmap_destroy (journals[i].logged);
+        journals[i].enabled = false;
+      }
+}
+
+/* Returns the volume number recorded in the journal header on
+   DEVICE, or -1 if DEVICE has no journal. */
+int
+journal_volume (struct block *device)
+{
+  struct journal_header header;
+
+  block_read (device, JOURNAL_SECTOR, &header);
+  return header.magic == JOURNAL_MAGIC ? (int) header.volume : -1;
+}
+
+/* Marks the start of a file system operation.  Metadata updates
+   made before the matching journal_end() are committed together.
+   The operation may modify at most JOURNAL_OP_MAX sectors on each
+   volume. */
+void
+journal_begin (void)
+{
+  if (handle_cnt == 0 && !journal_has_room ())
+    journal_commit ();
+  handle_cnt++;
+}
+
+/* Marks the end of a file system operation.  Commits the running
+   transaction if no other operation is in progress and it has
+   grown large enough on some volume. */
+void
+journal_end (void)
+{
+  ASSERT (handle_cnt > 0);
+
+  /* The operation's free map changes belong to it too. */
+  if (handle_cnt == 1 && any_enabled ())
+    free_map_flush ();
+
+  if (--handle_cnt == 0 && any_enabled ())
+    {
+      int i;
+
+      for (i = 0; i < VOLUME_MAX; i++)
+        if (journals[i].txn_cnt >= GROUP_COMMIT_CNT)
+          {
+            journal_commit ();
+            break;
+          }
+    }
+}
+
+/* Ends the operation in progress and begins another, so that the
+   running transaction may be committed in between.  An operation
+   that could modify more than JOURNAL_OP_MAX sectors calls this at
+   points where the updates it has made so far are consistent by
+   themselves.  Outside any operation, lets the running transaction
+   be committed if it is short of room.  Does nothing inside a
+   nested operation, which cannot be split. */
+void
+journal_restart (void)
+{
+  if (handle_cnt == 1)
+    {
+      journal_end ();
+      journal_begin ();
+    }
+  else if (handle_cnt == 0)
+    {
+      journal_begin ();
+      journal_end ();
+    }
+}
+
+/* Copies BLOCK_SECTOR_SIZE bytes from BUFFER into metadata sector
+   SECTOR, by way of the buffer cache, as part of the running
+   transaction. */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  int index = cache_overwrite (sector, buffer);
+  buffer_cache.cache[index].dirty = true;
+  journal_dirty (index);
+  cache_operation_done (index);
+}
+
+/* Adds the sector in buffer cache entry INDEX, which the caller
+   has just modified and must still hold, to the running
+   transaction. */
+void
+journal_dirty (int index)
+{
+  struct cache_entry *e = &buffer_cache.cache[index];
+  struct journal *j = &journals[sector_volume (e->sector)];
+  size_t i;
+
+  if (!j->enabled)
+    return;
+
+  e->journaled = true;
+  for (i = 0; i < j->txn_cnt; i++)
+    if (j->txn[i] == e->sector)
+      return;
+
+  if (j->txn_cnt >= TXN_MAX_CNT)
+    {
+      /* An update made outside any operation is an operation by
+         itself, so the transaction may be committed before it. */
+      if (handle_cnt > 0 || committing)
+        PANIC ("journal: operation too large");
+      journal_commit ();
+    }
+  j->txn[j->txn_cnt++] = e->sector;
+}
+
+/* Notes that the running transaction makes the file whose inode is
+   in sector OWNER refer to data that may be dirty in the buffer
+   cache, by mapping sectors or extending the file, so that the
+   file's data is written back before the transaction commits. */
+void
+journal_data (block_sector_t owner)
+{
+  size_t i;
+
+  if (!journals[sector_volume (owner)].enabled || data_overflow)
+    return;
+
+  for (i = 0; i < data_owner_cnt; i++)
+    if (data_owners[i] == owner)
+      return;
+  if (data_owner_cnt < DATA_OWNER_MAX)
+    data_owners[data_owner_cnt++] = owner;
+  else
+    data_overflow = true;
+}
+
+/* Called when the CNT sectors starting at SECTOR, all on one
+   volume, have been freed.  Their contents no longer matter, so
+   drops any of them from the running transaction, which then
+   neither logs them nor keeps them pinned. */
+void
+journal_forget (block_sector_t sector, size_t cnt)
+{
+  struct journal *j = &journals[sector_volume (sector)];
+  size_t i = 0;
+
+  if (!j->enabled)
+    return;
+
+  while (i < j->txn_cnt)
+    if (j->txn[i] - sector < cnt)
+      {
+        int index = cache_find (j->txn[i]);
+        ASSERT (index != -1);
+        buffer_cache.cache[index].journaled = false;
+        cache_operation_done (index);
+        j->txn[i] = j->txn[--j->txn_cnt];
+      }
+    else
+      i++;
+}
+
+/* Called when the CNT sectors starting at SECTOR, all on one
+   volume, have just been allocated.  If the volume's log still
+   holds a copy of any of them from before it was freed, a replay
+   would overwrite the sector's new contents with it, so
+   checkpoints the log first. */
+void
+journal_reuse (block_sector_t sector, size_t cnt)
+{
+  struct journal *j = &journals[sector_volume (sector)];
+
+  if (j->enabled
+      && bitmap_contains (j->logged, sector_offset (sector), cnt, true))
+    checkpoint (j);
+}
+
+/* Returns true if the running transaction has room for
+   JOURNAL_OP_MAX more sectors on every volume, besides the free
+   map and reference count sectors that will join it when the
+   operation in progress ends. */
+bool
+journal_has_room (void)
+{
+  int i;
+
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (journals[i].enabled
+        && (journals[i].txn_cnt + free_map_dirty_cnt (i) + JOURNAL_OP_MAX
+            > TXN_MAX_CNT))
+      return false;
+  return true;
+}
+
+/* Writes the running transaction to the logs and starts a new
+   one. */
+void
+journal_commit (void)
+{
+  int i;
+
+  ASSERT (handle_cnt == 0);
+
+  if (!any_enabled () || committing)
+    return;
+  committing = true;
+
+  /* Block maps in the log may point to data sectors that are only
+     dirty in the cache so far.  Write the data first, so that
+     after a crash no file refers to a sector whose contents never
+     reached the disk. */
+  free_map_flush ();
+  write_back_data ();
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (journals[i].enabled && journals[i].txn_cnt > 0)
+      commit_volume (&journals[i]);
+
+  committing = false;
+}
+
+/* Makes every metadata update made so far durable.  With a
+   journal, committing the running transaction suffices; without
+   one, all dirty sectors must be written home. */
+void
+journal_sync (void)
+{
+  if (any_enabled ())
+    journal_commit ();
+  else
+    {
+      free_map_flush ();
+      cache_write_back ();
+    }
+}
+
+/* Writes back the data of the files reported to journal_data()
+   since the last commit and forgets them. */
+static void
+write_back_data (void)
+{
+  size_t i;
+
+  if (data_overflow)
+    cache_write_back_data ();
+  else
+    for (i = 0; i < data_owner_cnt; i++)
+      cache_write_back_owner (data_owners[i]);
+  data_owner_cnt = 0;
+  data_overflow = false;
+}
+
+/* Returns true if any volume's updates are being logged. */
+static bool
+any_enabled (void)
+{
+  int i;
+
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (journals[i].enabled)
+      return true;
+  return false;
+}
+
+
+/* Writes J's part of the running transaction to its log. */
+static void
+commit_volume (struct journal *j)
+{
+  block_sector_t pos;
+  size_t i;
+
+  /* Descriptor, then the copies. */
+  memset (&desc, 0, sizeof desc);
+  desc.magic = DESC_MAGIC;
+  desc.seq = j->seq;
+  desc.cnt = j->txn_cnt;
+  memcpy (desc.sectors, j->txn, j->txn_cnt * sizeof *j->txn);
+  pos = j->header.start + j->head;
+  volume_write (pos++, &desc);
+  for (i = 0; i < j->txn_cnt; i++)
+    {
+      int index = cache_lookup (j->txn[i]);
+      volume_write (pos++, buffer_cache.cache[index].data);
+      cache_operation_done (index);
+    }
+
+  /* The transaction is durable once its commit record is. */
+  memset (&commit, 0, sizeof commit);
+  commit.magic = COMMIT_MAGIC;
+  commit.seq = j->seq;
+  volume_write (pos++, &commit);
+
+  /* Now the sectors may be written home. */
+  for (i = 0; i < j->txn_cnt; i++)
+    {
+      int index = cache_lookup (j->txn[i]);
+      buffer_cache.cache[index].journaled = false;
+      cache_operation_done (index);
+      bitmap_mark (j->logged, sector_offset (j->txn[i]));
+    }
+
+  j->head = pos - j->header.start;
+  j->seq++;
+  j->txn_cnt = 0;
+
+  /* Make sure the largest possible transaction fits. */
+  if (j->header.size - j->head < DESC_CNT + 2)
+    checkpoint (j);
+}
+
+/* Copies every committed transaction in J's log, in order, to its
+   home location, and empties the log. */
+static void
+replay (struct journal *j)
+{
+  block_sector_t pos = 0;
+  int replayed = 0;
+
+  j->seq = j->header.seq;
+  while (j->header.size - pos >= 2)
+    {
+      block_sector_t commit_pos;
+      size_t i;
+
+      volume_read (j->header.start + pos, &desc);
+      if (desc.magic != DESC_MAGIC || desc.seq != j->seq
+          || desc.cnt > DESC_CNT || desc.cnt + 2 > j->header.size - pos)
+        break;
+
+      /* A transaction without a commit record never happened. */
+      commit_pos = j->header.start + pos + 1 + desc.cnt;
+      volume_read (commit_pos, &commit);
+      if (commit.magic != COMMIT_MAGIC || commit.seq != j->seq)
+        break;
+
+      for (i = 0; i < desc.cnt; i++)
+        if (sector_volume (desc.sectors[i]) == (int) j->header.volume)
+          {
+            volume_read (j->header.start + pos + 1 + i, copy);
+            volume_write (desc.sectors[i], copy);
+          }
+      pos += desc.cnt + 2;
+      j->seq++;
+      replayed++;
+    }
+
+  if (replayed > 0)
+    printf ("journal: replayed %d transaction(s)\n", replayed);
+
+  j->head = 0;
+  write_header (j);
+}
+
+/* Writes all dirty sectors in the buffer cache home and empties
+   J's log.  Must not be called while a transaction is being
+   written to the log. */
+static void
+checkpoint (struct journal *j)
+{
+  cache_write_back ();
+  j->head = 0;
+  write_header (j);
+  bitmap_set_all (j->logged, false);
+}
+
+/* Writes J's header, recording J's SEQ as the number of the first
+   transaction in the log. */
+static void
+write_header (struct journal *j)
+{
+  j->header.seq = j->seq;
+  volume_write (volume_sector (j->header.volume, JOURNAL_SECTOR),
+                &j->header);
+}
@@ -0,0 +1,30 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most metadata sectors, counting free map and reference count
+   sectors, that one operation, or one step of a long operation
+   between calls to journal_has_room(), may modify on a volume. */
+#define JOURNAL_OP_MAX 32
+
+void journal_create (int volume);
+void journal_open (int volume);
+void journal_close (void);
+int journal_volume (struct block *);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_restart (void);
+bool journal_has_room (void);
+void journal_write (block_sector_t, const void *);
+void journal_dirty (int);
+void journal_data (block_sector_t owner);
+void journal_forget (block_sector_t, size_t cnt);
+void journal_reuse (block_sector_t, size_t cnt);
+void journal_commit (void);
+void journal_sync (void);
+
+#endif /* filesys/journal.h */
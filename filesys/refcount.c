@@ -0,0 +1,322 @@
+#include "filesys/refcount.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+
+/* Reference counts of data sectors shared by more than one file,
+   as a result of cloning.  A sector that is allocated in the free
+   map but not listed here has exactly one reference.  Releasing a
+   shared sector through the free map only drops a reference.
+
+   Each volume's counts are kept in memory in a hash table and saved
+   in its reference count file, whose inode is in REFCOUNT_SECTOR of
+   the volume.  Like the free map file, it has a fixed size and an
+   entry for every sector of the volume: the number of references
+   beyond the first, as a 32-bit integer.  So a change to a count
+   only rewrites the one sector of the file that holds it, and a
+   series of changes to neighboring sectors, as cloning a file makes,
+   rewrites few.  Sectors are only ever shared within a volume. */
+
+/* Number of counts stored in one sector of the reference count
+   file. */
+#define COUNTS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (uint32_t))
+
+/* A shared sector. */
+struct refcount
+  {
+    struct hash_elem elem;              /* Element in REFCOUNTS. */
+    block_sector_t sector;              /* Shared sector. */
+    uint32_t extra;                     /* References beyond the first. */
+  };
+
+/* A volume's reference counts. */
+struct refcounts
+  {
+    struct hash counts;                 /* Shared sectors. */
+    struct file *file;                  /* Reference count file. */
+
+    /* Sectors of the reference count file whose counts have changed
+       since they were last written, one bit per sector.  Changes
+       are written back together by refcount_flush(). */
+    struct bitmap *dirty_map;
+    size_t dirty_cnt;                   /* Number of bits set in
+                                           DIRTY_MAP. */
+  };
+
+static struct refcounts volumes[VOLUME_MAX];
+
+static hash_hash_func refcount_hash;
+static hash_less_func refcount_less;
+static hash_action_func refcount_free;
+static bool flush (struct refcounts *);
+static struct refcount *find (block_sector_t);
+static void mark_dirty (block_sector_t);
+
+/* Returns the size of VOLUME's reference count file in bytes. */
+static off_t
+file_size (int volume)
+{
+  return block_size (volume_device (volume)) * sizeof (uint32_t);
+}
+
+/* Initializes VOLUME's reference count table, with no shared
+   sectors.  VOLUME must be attached. */
+void
+refcount_init (int volume)
+{
+  struct refcounts *rc = &volumes[volume];
+
+  if (!hash_init (&rc->counts, refcount_hash, refcount_less, NULL))
+    PANIC ("reference count table creation failed");
+  rc->dirty_map = bitmap_create (DIV_ROUND_UP (file_size (volume),
+                                               BLOCK_SECTOR_SIZE));
+  if (rc->dirty_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+}
+
+/* Creates VOLUME's reference count file, with every count zero, and
+   opens it. */
+void
+refcount_create (int volume)
+{
+  struct refcounts *rc = &volumes[volume];
+  block_sector_t sector = volume_sector (volume, REFCOUNT_SECTOR);
+
+  if (!inode_create (sector, file_size (volume)))
+    PANIC ("reference count file creation failed");
+  rc->file = file_open (inode_open (sector, false));
+  if (rc->file == NULL)
+    PANIC ("can't open reference count file");
+  bitmap_set_all (rc->dirty_map, false);
+  rc->dirty_cnt = 0;
+}
+
+/* Opens VOLUME's reference count file and reads it from disk. */
+void
+refcount_open (int volume)
+{
+  static uint32_t counts[COUNTS_PER_SECTOR];
+  struct refcounts *rc = &volumes[volume];
+  off_t ofs;
+
+  rc->file = file_open (inode_open (volume_sector (volume, REFCOUNT_SECTOR),
+                                    false));
+  if (rc->file == NULL)
+    PANIC ("can't open reference count file");
+  if (file_length (rc->file) != file_size (volume))
+    PANIC ("reference count file has the wrong size");
+
+  for (ofs = 0; ofs < file_size (volume); ofs += sizeof counts)
+    {
+      block_sector_t first = ofs / sizeof *counts;
+      size_t i;
+
+      if (file_read_at (rc->file, counts, sizeof counts, ofs)
+          != sizeof counts)
+        PANIC ("can't read reference count file");
+      for (i = 0; i < COUNTS_PER_SECTOR; i++)
+        if (counts[i] != 0)
+          {
+            struct refcount *r = malloc (sizeof *r);
+            if (r == NULL)
+              PANIC ("reference count table is too large");
+            r->sector = volume_sector (volume, first + i);
+            r->extra = counts[i];
+            hash_insert (&rc->counts, &r->elem);
+          }
+    }
+  bitmap_set_all (rc->dirty_map, false);
+  rc->dirty_cnt = 0;
+}
+
+/* Writes VOLUME's reference counts to disk and closes its
+   reference count file. */
+void
+refcount_close (int volume)
+{
+  struct refcounts *rc = &volumes[volume];
+
+  if (!flush (rc))
+    printf ("reference counts: write-back failed\n");
+  file_close (rc->file);
+  rc->file = NULL;
+  hash_clear (&rc->counts, refcount_free);
+}
+
+/* Writes the sectors of each volume's reference count file whose
+   counts have changed since the last flush.  Returns true if
+   successful, false if some sector could not be written; those
+   remain dirty. */
+bool
+refcount_flush (void)
+{
+  bool success = true;
+  int i;
+
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (!flush (&volumes[i]))
+      success = false;
+  return success;
+}
+
+/* Writes the sectors of RC's reference count file whose counts
+   have changed.  Returns true if successful. */
+static bool
+flush (struct refcounts *rc)
+{
+  static uint32_t counts[COUNTS_PER_SECTOR];
+  int volume = rc - volumes;
+  size_t idx = 0;
+  bool success = true;
+
+  if (rc->file == NULL)
+    return true;
+
+  while ((idx = bitmap_scan (rc->dirty_map, idx, 1, true)) != BITMAP_ERROR)
+    {
+      block_sector_t first = idx * COUNTS_PER_SECTOR;
+      size_t i;
+
+      for (i = 0; i < COUNTS_PER_SECTOR; i++)
+        {
+          struct refcount *r = find (volume_sector (volume, first + i));
+          counts[i] = r != NULL ? r->extra : 0;
+        }
+
+      /* Clear the bit first, so that a flush nested inside the
+         write below skips this sector. */
+      bitmap_reset (rc->dirty_map, idx);
+      rc->dirty_cnt--;
+      if (file_write_at (rc->file, counts, sizeof counts,
+                         idx * sizeof counts) != sizeof counts)
+        {
+          mark_dirty (volume_sector (volume, first));
+          success = false;
+        }
+      idx++;
+    }
+  return success;
+}
+
+/* Adds a reference to SECTOR, which must be allocated.  Returns
+   true if successful, false if memory is exhausted. */
+bool
+refcount_share (block_sector_t sector)
+{
+  struct refcounts *rc = &volumes[sector_volume (sector)];
+  struct refcount *r = find (sector);
+
+  if (r == NULL)
+    {
+      r = malloc (sizeof *r);
+      if (r == NULL)
+        return false;
+      r->sector = sector;
+      r->extra = 0;
+      hash_insert (&rc->counts, &r->elem);
+    }
+  r->extra++;
+  mark_dirty (sector);
+  return true;
+}
+
+/* Returns true if more than one file refers to SECTOR. */
+bool
+refcount_is_shared (block_sector_t sector)
+{
+  return (!hash_empty (&volumes[sector_volume (sector)].counts)
+          && find (sector) != NULL);
+}
+
+/* Drops a reference to SECTOR if it is shared, and returns true;
+   the sector stays allocated.  Returns false if SECTOR has only
+   one reference, in which case the caller should free it. */
+bool
+refcount_drop (block_sector_t sector)
+{
+  struct refcounts *rc = &volumes[sector_volume (sector)];
+  struct refcount *r = find (sector);
+
+  if (r == NULL)
+    return false;
+  if (--r->extra == 0)
+    {
+      hash_delete (&rc->counts, &r->elem);
+      free (r);
+    }
+  mark_dirty (sector);
+  return true;
+}
+
+/* Returns true if any sector on VOLUME is shared. */
+bool
+refcount_any (int volume)
+{
+  return !hash_empty (&volumes[volume].counts);
+}
+
+/* Returns the number of sectors of VOLUME's reference count file
+   that refcount_flush() would write. */
+size_t
+refcount_dirty_cnt (int volume)
+{
+  return volumes[volume].dirty_cnt;
+}
+
+/* Returns the entry for SECTOR, or a null pointer if SECTOR is not
+   shared. */
+static struct refcount *
+find (block_sector_t sector)
+{
+  struct refcount key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&volumes[sector_volume (sector)].counts, &key.elem);
+  return e != NULL ? hash_entry (e, struct refcount, elem) : NULL;
+}
+
+/* Records that the count of SECTOR has changed. */
+static void
+mark_dirty (block_sector_t sector)
+{
+  struct refcounts *rc = &volumes[sector_volume (sector)];
+  size_t idx = sector_offset (sector) / COUNTS_PER_SECTOR;
+
+  if (!bitmap_test (rc->dirty_map, idx))
+    {
+      bitmap_mark (rc->dirty_map, idx);
+      rc->dirty_cnt++;
+    }
+}
+
+/* Returns a hash value for refcount E. */
+static unsigned
+refcount_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct refcount *r = hash_entry (e, struct refcount, elem);
+  return hash_int (r->sector);
+}
+
+/* Returns true if refcount A precedes refcount B. */
+static bool
+refcount_less (const struct hash_elem *a, const struct hash_elem *b,
+               void *aux UNUSED)
+{
+  return (hash_entry (a, struct refcount, elem)->sector
+          < hash_entry (b, struct refcount, elem)->sector);
+}
+
+/* Frees refcount E. */
+static void
+refcount_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct refcount, elem));
+}
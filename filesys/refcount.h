@@ -0,0 +1,20 @@
+#ifndef FILESYS_REFCOUNT_H
+#define FILESYS_REFCOUNT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void refcount_init (int volume);
+void refcount_create (int volume);
+void refcount_open (int volume);
+void refcount_close (int volume);
+bool refcount_flush (void);
+
+bool refcount_share (block_sector_t);
+bool refcount_is_shared (block_sector_t);
+bool refcount_drop (block_sector_t);
+bool refcount_any (int volume);
+size_t refcount_dirty_cnt (int volume);
+
+#endif /* filesys/refcount.h */
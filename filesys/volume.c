@@ -0,0 +1,117 @@
+#include "filesys/volume.h"
+#include <debug.h>
+#include "filesys/filesys.h"
+
+/* A file system volume. */
+struct volume
+  {
+    struct block *device;               /* Device, or null if unused. */
+    block_sector_t mount_point;         /* Inode sector of the directory
+                                           it is mounted on, or 0 for
+                                           the root. */
+  };
+
+static struct volume volumes[VOLUME_MAX];
+
+/* Makes DEVICE volume number VOLUME, which must be unused, and
+   mounts it on the directory whose inode is in MOUNT_POINT, or on
+   nothing if MOUNT_POINT is 0.  DEVICE must have fewer than
+   VOLUME_SECTORS sectors. */
+void
+volume_attach (int volume, struct block *device, block_sector_t mount_point)
+{
+  ASSERT (volume >= 0 && volume < VOLUME_MAX);
+  ASSERT (volumes[volume].device == NULL);
+  ASSERT (block_size (device) < VOLUME_SECTORS);
+
+  volumes[volume].device = device;
+  volumes[volume].mount_point = mount_point;
+}
+
+/* Returns the device of VOLUME, or a null pointer if VOLUME is
+   not in use. */
+struct block *
+volume_device (int volume)
+{
+  ASSERT (volume >= 0 && volume < VOLUME_MAX);
+  return volumes[volume].device;
+}
+
+/* Returns the lowest unused volume number, or -1 if all are in
+   use. */
+int
+volume_unused (void)
+{
+  int i;
+
+  for (i = 0; i < VOLUME_MAX; i++)
+    if (volumes[i].device == NULL)
+      return i;
+  return -1;
+}
+
+/* If a volume is mounted on the directory whose inode is in
+   SECTOR, returns the sector of that volume's root directory
+   inode.  Otherwise, returns SECTOR. */
+block_sector_t
+volume_follow_mount (block_sector_t sector)
+{
+  int i;
+
+  for (i = 1; i < VOLUME_MAX; i++)
+    if (volumes[i].device != NULL && volumes[i].mount_point == sector)
+      return volume_sector (i, ROOT_DIR_SECTOR);
+  return sector;
+}
+
+/* Returns true if a volume is mounted on the directory whose
+   inode is in SECTOR. */
+bool
+volume_is_mount_point (block_sector_t sector)
+{
+  return volume_follow_mount (sector) != sector;
+}
+
+/* Returns the device that holds SECTOR, which must be on a volume
+   in use. */
+static struct block *
+device_of (block_sector_t sector)
+{
+  struct block *device = volumes[sector_volume (sector)].device;
+  ASSERT (device != NULL);
+  return device;
+}
+
+/* Reads SECTOR from its volume's device into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+void
+volume_read (block_sector_t sector, void *buffer)
+{
+  block_read (device_of (sector), sector_offset (sector), buffer);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to SECTOR on its
+   volume's device. */
+void
+volume_write (block_sector_t sector, const void *buffer)
+{
+  block_write (device_of (sector), sector_offset (sector), buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR, which must
+   all be on one volume, into BUFFER. */
+void
+volume_read_range (block_sector_t sector, block_sector_t cnt, void *buffer)
+{
+  block_read_range (device_of (sector), sector_offset (sector), cnt, buffer);
+}
+
+/* Writes CNT sectors from BUFFER to the consecutive sectors
+   starting at SECTOR, which must all be on one volume. */
+void
+volume_write_range (block_sector_t sector, block_sector_t cnt,
+                    const void *buffer)
+{
+  block_write_range (device_of (sector), sector_offset (sector), cnt,
+                     buffer);
+}
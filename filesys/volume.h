@@ -0,0 +1,57 @@
+#ifndef FILESYS_VOLUME_H
+#define FILESYS_VOLUME_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* File system volumes.
+
+   The root file system is volume 0.  Each file system mounted on a
+   directory is another volume, each on its own block device, up to
+   VOLUME_MAX in all.  Above the block layer, every sector number --
+   in inodes, index blocks, directory entries, the free map, the
+   journal and the buffer cache -- carries its volume in its top
+   VOLUME_BITS bits.  A file system is formatted with its volume
+   number, so its on-disk pointers already name its volume, and only
+   the code that does I/O has to take sector numbers apart. */
+#define VOLUME_BITS 2
+#define VOLUME_MAX (1 << VOLUME_BITS)
+#define VOLUME_SHIFT (32 - VOLUME_BITS)
+
+/* Devices must have fewer sectors than this to hold a volume. */
+#define VOLUME_SECTORS ((block_sector_t) 1 << VOLUME_SHIFT)
+
+/* Returns the sector number for sector OFS of VOLUME. */
+static inline block_sector_t
+volume_sector (int volume, block_sector_t ofs)
+{
+  return ((block_sector_t) volume << VOLUME_SHIFT) | ofs;
+}
+
+/* Returns the volume that SECTOR belongs to. */
+static inline int
+sector_volume (block_sector_t sector)
+{
+  return sector >> VOLUME_SHIFT;
+}
+
+/* Returns SECTOR's offset within its volume's device. */
+static inline block_sector_t
+sector_offset (block_sector_t sector)
+{
+  return sector & (VOLUME_SECTORS - 1);
+}
+
+void volume_attach (int volume, struct block *, block_sector_t mount_point);
+struct block *volume_device (int volume);
+int volume_unused (void);
+
+block_sector_t volume_follow_mount (block_sector_t);
+bool volume_is_mount_point (block_sector_t);
+
+void volume_read (block_sector_t, void *);
+void volume_write (block_sector_t, const void *);
+void volume_read_range (block_sector_t, block_sector_t cnt, void *);
+void volume_write_range (block_sector_t, block_sector_t cnt, const void *);
+
+#endif /* filesys/volume.h */
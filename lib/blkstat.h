@@ -0,0 +1,34 @@
+#ifndef __LIB_BLKSTAT_H
+#define __LIB_BLKSTAT_H
+
+/* Number of buckets in a latency histogram. */
+#define BLKSTAT_BUCKETS 40
+
+/* Statistics for a block device, written by the blkstat system
+   call.  Latency, queue depth and access pattern are tracked by
+   the device that carries out requests, so they are zero for
+   partitions. */
+struct blkstat
+  {
+    unsigned long long read_cnt;        /* Sectors read. */
+    unsigned long long write_cnt;       /* Sectors written. */
+
+    /* Requests completed, by time from submission to completion:
+       latency[I] counts those that took 2**I to 2**(I+1) - 1 CPU
+       cycles.  The last bucket also counts any slower ones. */
+    unsigned long long latency[BLKSTAT_BUCKETS];
+
+    /* Queue depth, sampled as each request is submitted: the
+       number of requests submitted earlier and not yet
+       completed. */
+    unsigned long long depth_samples;   /* Number of samples. */
+    unsigned long long depth_sum;       /* Sum of samples. */
+    unsigned depth_max;                 /* Largest sample. */
+
+    /* Requests passed to the driver, by whether each began at the
+       sector following the end of the previous one. */
+    unsigned long long sequential;      /* Began where last one ended. */
+    unsigned long long random;          /* Needed a seek. */
+  };
+
+#endif /* lib/blkstat.h */
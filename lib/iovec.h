@@ -0,0 +1,17 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* Maximum number of iovecs in one readv or writev call. */
+#define IOV_MAX 64
+
+/* One segment of a buffer for vectored I/O, used by the readv and
+   writev system calls. */
+struct iovec
+  {
+    void *iov_base;             /* Start of segment. */
+    size_t iov_len;             /* Segment length in bytes. */
+  };
+
+#endif /* lib/iovec.h */
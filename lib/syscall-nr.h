@@ -28,7 +28,23 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_STAT,                   /* Obtain a file's size, type and inumber. */
+    SYS_FSTAT,                  /* Same as SYS_STAT, for an open fd. */
+    SYS_FSYNC,                  /* Write a file's changes to disk. */
+    SYS_SYNC,                   /* Write all changes to disk. */
+    SYS_FALLOCATE,              /* Reserve disk space for a file. */
+    SYS_FTRUNCATE,              /* Change a file's length. */
+    SYS_COPY_FILE_RANGE,        /* Copy data between open files. */
+    SYS_CLONE,                  /* Copy a file by sharing its blocks. */
+    SYS_PREAD,                  /* Read from a file at a given offset. */
+    SYS_PWRITE,                 /* Write to a file at a given offset. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV,                 /* Write several buffers to a file. */
+    SYS_DIRECT_IO,              /* Turn uncached I/O on or off. */
+    SYS_BLKSTAT                 /* Get block device statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -2,7 +2,9 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <blkstat.h>
 #include <debug.h>
+#include <iovec.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -15,6 +17,14 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 17
 
+/* File status written by stat() and fstat(). */
+struct stat
+  {
+    int size;                   /* Size in bytes. */
+    bool isdir;                 /* True if a directory. */
+    int inumber;                /* Inode number. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +55,20 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool stat (const char *file, struct stat *);
+bool fstat (int fd, struct stat *);
+bool fsync (int fd);
+void sync (void);
+bool fallocate (int fd, int offset, int len);
+bool ftruncate (int fd, int length);
+int copy_file_range (int in_fd, int out_fd, int length);
+bool clone (const char *src, const char *dst);
+int pread (int fd, void *buffer, unsigned length, int offset);
+int pwrite (int fd, const void *buffer, unsigned length, int offset);
+int readv (int fd, const struct iovec *, int iov_cnt);
+int writev (int fd, const struct iovec *, int iov_cnt);
+bool direct_io (int fd, bool enable);
+bool blkstat (const char *device, struct blkstat *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,40 @@
+/* Checks that blkstat reports reads of the disk that holds the
+   file system, that writing and syncing a file adds to its write
+   count, and that it fails for a device that does not exist. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1024];
+
+void
+test_main (void) 
+{
+  struct blkstat before, after;
+  int fd;
+
+  memset (buf, 'k', sizeof buf);
+
+  CHECK (blkstat ("hda", &before), "blkstat \"hda\"");
+  if (before.read_cnt == 0)
+    fail ("blkstat \"hda\": no sectors read");
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  CHECK (fsync (fd), "fsync \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+
+  CHECK (blkstat ("hda", &after), "blkstat \"hda\"");
+  if (after.read_cnt < before.read_cnt)
+    fail ("blkstat \"hda\": read count went down");
+  if (after.write_cnt < before.write_cnt + 2)
+    fail ("blkstat \"hda\": fewer than 2 sectors written by fsync");
+
+  CHECK (!blkstat ("nodev", &after), "blkstat \"nodev\" (must return false)");
+
+  check_file ("a", buf, sizeof buf);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blkstat-dev) begin
+(blkstat-dev) blkstat "hda"
+(blkstat-dev) create "a"
+(blkstat-dev) open "a"
+(blkstat-dev) write "a"
+(blkstat-dev) fsync "a"
+(blkstat-dev) close "a"
+(blkstat-dev) blkstat "hda"
+(blkstat-dev) blkstat "nodev" (must return false)
+(blkstat-dev) open "a" for verification
+(blkstat-dev) verified contents of "a"
+(blkstat-dev) close "a"
+(blkstat-dev) end
+EOF
+pass;
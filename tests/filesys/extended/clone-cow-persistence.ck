@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["o" x 2000, "A" x 100, "o" x 900],
+		"b" => ["B" x 100, "o" x 2900]});
+pass;
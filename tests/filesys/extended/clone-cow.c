@@ -0,0 +1,49 @@
+/* Clones a file, then writes first to the clone and then to the
+   original, and checks after each write that the other file did
+   not change. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf_a[3000];
+static char buf_b[3000];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf_a, 'o', sizeof buf_a);
+  memset (buf_b, 'o', sizeof buf_b);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf_a, sizeof buf_a) == sizeof buf_a, "write \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+
+  CHECK (clone ("a", "b"), "clone \"a\" to \"b\"");
+  CHECK (!clone ("a", "b"), "clone \"a\" to \"b\" again (must return false)");
+  CHECK (!clone ("c", "d"), "clone \"c\" to \"d\" (must return false)");
+  check_file ("b", buf_b, sizeof buf_b);
+
+  memset (buf_b, 'B', 100);
+  CHECK ((fd = open ("b")) > 1, "open \"b\"");
+  CHECK (write (fd, buf_b, 100) == 100, "write 100 bytes to \"b\"");
+  msg ("close \"b\"");
+  close (fd);
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, sizeof buf_b);
+
+  memset (buf_a + 2000, 'A', 100);
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  msg ("seek \"a\" to 2000");
+  seek (fd, 2000);
+  CHECK (write (fd, buf_a + 2000, 100) == 100, "write 100 bytes to \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, sizeof buf_b);
+}
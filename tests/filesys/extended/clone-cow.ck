@@ -0,0 +1,38 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-cow) begin
+(clone-cow) create "a"
+(clone-cow) open "a"
+(clone-cow) write "a"
+(clone-cow) close "a"
+(clone-cow) clone "a" to "b"
+(clone-cow) clone "a" to "b" again (must return false)
+(clone-cow) clone "c" to "d" (must return false)
+(clone-cow) open "b" for verification
+(clone-cow) verified contents of "b"
+(clone-cow) close "b"
+(clone-cow) open "b"
+(clone-cow) write 100 bytes to "b"
+(clone-cow) close "b"
+(clone-cow) open "a" for verification
+(clone-cow) verified contents of "a"
+(clone-cow) close "a"
+(clone-cow) open "b" for verification
+(clone-cow) verified contents of "b"
+(clone-cow) close "b"
+(clone-cow) open "a"
+(clone-cow) seek "a" to 2000
+(clone-cow) write 100 bytes to "a"
+(clone-cow) close "a"
+(clone-cow) open "a" for verification
+(clone-cow) verified contents of "a"
+(clone-cow) close "a"
+(clone-cow) open "b" for verification
+(clone-cow) verified contents of "b"
+(clone-cow) close "b"
+(clone-cow) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["c" x 1000, "d" x 1000],
+		"b" => ["c" x 500, "d" x 1000]});
+pass;
@@ -0,0 +1,56 @@
+/* Copies part of one file into another with copy_file_range,
+   checking the byte counts returned and the file positions after
+   each call, and checks that copying within one file fails. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[2000];
+
+static void
+check_tell (const char *file_name, int fd, int ofs) 
+{
+  if (tell (fd) != (unsigned) ofs)
+    fail ("position of \"%s\" is %u, should be %d",
+          file_name, tell (fd), ofs);
+}
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+
+  memset (buf, 'c', 1000);
+  memset (buf + 1000, 'd', 1000);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+  CHECK (write (fd_a, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  msg ("seek \"a\" to 500");
+  seek (fd_a, 500);
+
+  CHECK (copy_file_range (fd_a, fd_b, 1000) == 1000,
+         "copy 1000 bytes from \"a\" to \"b\"");
+  check_tell ("a", fd_a, 1500);
+  check_tell ("b", fd_b, 1000);
+  CHECK (copy_file_range (fd_a, fd_b, 1000) == 500,
+         "copy 1000 bytes from \"a\" to \"b\" (must copy 500)");
+  check_tell ("a", fd_a, 2000);
+  check_tell ("b", fd_b, 1500);
+  CHECK (copy_file_range (fd_a, fd_b, 1000) == 0,
+         "copy at end of \"a\" (must copy 0)");
+  CHECK (copy_file_range (fd_a, fd_a, 10) == -1,
+         "copy from \"a\" to \"a\" (must return -1)");
+
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_file ("a", buf, sizeof buf);
+  check_file ("b", buf + 500, 1500);
+}
@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "a"
+(copy-range) create "b"
+(copy-range) open "a"
+(copy-range) open "b"
+(copy-range) write "a"
+(copy-range) seek "a" to 500
+(copy-range) copy 1000 bytes from "a" to "b"
+(copy-range) copy 1000 bytes from "a" to "b" (must copy 500)
+(copy-range) copy at end of "a" (must copy 0)
+(copy-range) copy from "a" to "a" (must return -1)
+(copy-range) close "a"
+(copy-range) close "b"
+(copy-range) open "a" for verification
+(copy-range) verified contents of "a"
+(copy-range) close "a"
+(copy-range) open "b" for verification
+(copy-range) verified contents of "b"
+(copy-range) close "b"
+(copy-range) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Writes and reads a file with direct I/O turned on, in whole
+   sectors followed by a partial one, then reads part of it again
+   through the buffer cache. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (4 * 512 + 100)
+
+static char buf[FILE_SIZE];
+static char rbuf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (direct_io (fd, true), "turn on direct I/O for \"a\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+
+  msg ("seek \"a\" to 0");
+  seek (fd, 0);
+  CHECK (read (fd, rbuf, sizeof rbuf) == sizeof rbuf, "read \"a\"");
+  compare_bytes (rbuf, buf, sizeof rbuf, 0, "a");
+
+  CHECK (direct_io (fd, false), "turn off direct I/O for \"a\"");
+  msg ("seek \"a\" to 512");
+  seek (fd, 512);
+  CHECK (read (fd, rbuf, 1024) == 1024, "read 1024 bytes from \"a\"");
+  compare_bytes (rbuf, buf + 512, 1024, 512, "a");
+
+  CHECK (!direct_io (STDOUT_FILENO, true),
+         "turn on direct I/O for the console (must return false)");
+  msg ("close \"a\"");
+  close (fd);
+
+  check_file ("a", buf, sizeof buf);
+}
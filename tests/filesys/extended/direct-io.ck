@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(direct-io) begin
+(direct-io) create "a"
+(direct-io) open "a"
+(direct-io) turn on direct I/O for "a"
+(direct-io) write "a"
+(direct-io) seek "a" to 0
+(direct-io) read "a"
+(direct-io) turn off direct I/O for "a"
+(direct-io) seek "a" to 512
+(direct-io) read 1024 bytes from "a"
+(direct-io) turn on direct I/O for the console (must return false)
+(direct-io) close "a"
+(direct-io) open "a" for verification
+(direct-io) verified contents of "a"
+(direct-io) close "a"
+(direct-io) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["r" x 3000, "\0" x 1000, "r" x 1000]});
+pass;
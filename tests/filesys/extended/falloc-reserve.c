@@ -0,0 +1,38 @@
+/* Reserves space in an empty file with fallocate, checks that its
+   length does not change, then writes into the reserved space,
+   leaving a gap that must read back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5000];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf, 'r', sizeof buf);
+  memset (buf + 3000, 0, 1000);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (fallocate (fd, 0, sizeof buf), "fallocate 5000 bytes in \"a\"");
+  if (filesize (fd) != 0)
+    fail ("fallocate changed the size of \"a\" to %d", filesize (fd));
+  CHECK (!fallocate (fd, -1, 10),
+         "fallocate at offset -1 (must return false)");
+  CHECK (!fallocate (fd, 0, -10),
+         "fallocate -10 bytes (must return false)");
+
+  CHECK (write (fd, buf, 3000) == 3000, "write 3000 bytes to \"a\"");
+  msg ("seek \"a\" to 4000");
+  seek (fd, 4000);
+  CHECK (write (fd, buf + 4000, 1000) == 1000, "write 1000 bytes to \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+
+  check_file ("a", buf, sizeof buf);
+}
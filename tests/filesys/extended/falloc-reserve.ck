@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(falloc-reserve) begin
+(falloc-reserve) create "a"
+(falloc-reserve) open "a"
+(falloc-reserve) fallocate 5000 bytes in "a"
+(falloc-reserve) fallocate at offset -1 (must return false)
+(falloc-reserve) fallocate -10 bytes (must return false)
+(falloc-reserve) write 3000 bytes to "a"
+(falloc-reserve) seek "a" to 4000
+(falloc-reserve) write 1000 bytes to "a"
+(falloc-reserve) close "a"
+(falloc-reserve) open "a" for verification
+(falloc-reserve) verified contents of "a"
+(falloc-reserve) close "a"
+(falloc-reserve) end
+EOF
+pass;
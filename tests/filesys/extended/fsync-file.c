@@ -0,0 +1,33 @@
+/* Writes a file in two parts, calling fsync after each, then
+   calls sync, and checks that the file's contents are correct. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3000];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf, 'f', 1000);
+  memset (buf + 1000, 'g', sizeof buf - 1000);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, 1000) == 1000, "write 1000 bytes to \"a\"");
+  CHECK (fsync (fd), "fsync \"a\"");
+  CHECK (write (fd, buf + 1000, sizeof buf - 1000) == sizeof buf - 1000,
+         "write 2000 bytes to \"a\"");
+  CHECK (fsync (fd), "fsync \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+
+  msg ("sync");
+  sync ();
+
+  check_file ("a", buf, sizeof buf);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-file) begin
+(fsync-file) create "a"
+(fsync-file) open "a"
+(fsync-file) write 1000 bytes to "a"
+(fsync-file) fsync "a"
+(fsync-file) write 2000 bytes to "a"
+(fsync-file) fsync "a"
+(fsync-file) close "a"
+(fsync-file) sync
+(fsync-file) open "a" for verification
+(fsync-file) verified contents of "a"
+(fsync-file) close "a"
+(fsync-file) end
+EOF
+pass;
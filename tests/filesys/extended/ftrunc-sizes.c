@@ -0,0 +1,48 @@
+/* Shrinks a file that uses an indirect block with ftruncate, then
+   grows it again, and checks that the regained bytes read back as
+   zeros rather than as the data that was cut off. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[60000];
+
+static void
+truncate_to (int fd, int length) 
+{
+  CHECK (ftruncate (fd, length), "ftruncate \"a\" to %d bytes", length);
+  if (filesize (fd) != length)
+    fail ("filesize of \"a\" is %d, should be %d", filesize (fd), length);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf, 't', sizeof buf);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  truncate_to (fd, 52000);
+  truncate_to (fd, 54000);
+  CHECK (!ftruncate (fd, -1),
+         "ftruncate \"a\" to -1 bytes (must return false)");
+  msg ("close \"a\"");
+  close (fd);
+
+  memset (buf + 52000, 0, 2000);
+  check_file ("a", buf, 54000);
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  truncate_to (fd, 700);
+  truncate_to (fd, 2000);
+  msg ("close \"a\"");
+  close (fd);
+
+  memset (buf + 700, 0, 1300);
+  check_file ("a", buf, 2000);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ftrunc-sizes) begin
+(ftrunc-sizes) create "a"
+(ftrunc-sizes) open "a"
+(ftrunc-sizes) write "a"
+(ftrunc-sizes) ftruncate "a" to 52000 bytes
+(ftrunc-sizes) ftruncate "a" to 54000 bytes
+(ftrunc-sizes) ftruncate "a" to -1 bytes (must return false)
+(ftrunc-sizes) close "a"
+(ftrunc-sizes) open "a" for verification
+(ftrunc-sizes) verified contents of "a"
+(ftrunc-sizes) close "a"
+(ftrunc-sizes) open "a"
+(ftrunc-sizes) ftruncate "a" to 700 bytes
+(ftrunc-sizes) ftruncate "a" to 2000 bytes
+(ftrunc-sizes) close "a"
+(ftrunc-sizes) open "a" for verification
+(ftrunc-sizes) verified contents of "a"
+(ftrunc-sizes) close "a"
+(ftrunc-sizes) end
+EOF
+pass;
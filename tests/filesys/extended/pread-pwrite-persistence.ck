@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["p" x 200, "w" x 10, "p" x 290, "W" x 100,
+			"p" x 400, "\0" x 200, "W" x 100]});
+pass;
@@ -0,0 +1,65 @@
+/* Reads and writes a file at explicit offsets with pread and
+   pwrite, including past end of file, and checks that neither
+   moves the file position that read and write use. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1300];
+static char data[100];
+static char rbuf[300];
+
+static void
+check_tell (int fd) 
+{
+  if (tell (fd) != 200)
+    fail ("position of \"a\" is %u, should be 200", tell (fd));
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf, 'p', 1000);
+  memset (data, 'W', sizeof data);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, 1000) == 1000, "write \"a\"");
+  msg ("seek \"a\" to 200");
+  seek (fd, 200);
+
+  CHECK (pwrite (fd, data, sizeof data, 500) == sizeof data,
+         "pwrite 100 bytes at offset 500");
+  memcpy (buf + 500, data, sizeof data);
+  check_tell (fd);
+
+  CHECK (pread (fd, rbuf, sizeof rbuf, 450) == sizeof rbuf,
+         "pread 300 bytes at offset 450");
+  compare_bytes (rbuf, buf + 450, sizeof rbuf, 450, "a");
+  check_tell (fd);
+
+  CHECK (pwrite (fd, data, sizeof data, 1200) == sizeof data,
+         "pwrite 100 bytes at offset 1200");
+  memcpy (buf + 1200, data, sizeof data);
+  if (filesize (fd) != sizeof buf)
+    fail ("filesize of \"a\" is %d, should be %zu", filesize (fd), sizeof buf);
+  check_tell (fd);
+
+  CHECK (pread (fd, rbuf, sizeof rbuf, 1300) == 0,
+         "pread at end of file (must return 0)");
+  CHECK (pread (fd, rbuf, sizeof rbuf, -1) == -1,
+         "pread at offset -1 (must return -1)");
+  CHECK (pwrite (fd, data, sizeof data, -1) == -1,
+         "pwrite at offset -1 (must return -1)");
+
+  memset (buf + 200, 'w', 10);
+  CHECK (write (fd, buf + 200, 10) == 10, "write 10 bytes at position 200");
+  msg ("close \"a\"");
+  close (fd);
+
+  check_file ("a", buf, sizeof buf);
+}
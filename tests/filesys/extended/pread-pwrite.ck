@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "a"
+(pread-pwrite) open "a"
+(pread-pwrite) write "a"
+(pread-pwrite) seek "a" to 200
+(pread-pwrite) pwrite 100 bytes at offset 500
+(pread-pwrite) pread 300 bytes at offset 450
+(pread-pwrite) pwrite 100 bytes at offset 1200
+(pread-pwrite) pread at end of file (must return 0)
+(pread-pwrite) pread at offset -1 (must return -1)
+(pread-pwrite) pwrite at offset -1 (must return -1)
+(pread-pwrite) write 10 bytes at position 200
+(pread-pwrite) close "a"
+(pread-pwrite) open "a" for verification
+(pread-pwrite) verified contents of "a"
+(pread-pwrite) close "a"
+(pread-pwrite) end
+EOF
+pass;
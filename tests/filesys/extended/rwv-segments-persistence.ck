@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["a" x 300, "b" x 1000, "c", "d" x 749]});
+pass;
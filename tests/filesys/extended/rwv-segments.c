@@ -0,0 +1,67 @@
+/* Writes a file with writev from segments that do not line up
+   with sector boundaries, one of them empty with a null base, then
+   reads it back with readv into segments of other sizes. */
+
+#include <iovec.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 2050
+
+static char seg_a[300], seg_b[1000], seg_c[1], seg_d[749];
+static char read_a[100], read_b[924], read_c[1026];
+static char buf[FILE_SIZE];
+
+/* Sets IOV to the CNT bytes at BASE. */
+static void
+set_iov (struct iovec *iov, void *base, size_t cnt) 
+{
+  iov->iov_base = base;
+  iov->iov_len = cnt;
+}
+
+void
+test_main (void) 
+{
+  struct iovec iov[5];
+  int fd;
+
+  memset (seg_a, 'a', sizeof seg_a);
+  memset (seg_b, 'b', sizeof seg_b);
+  memset (seg_c, 'c', sizeof seg_c);
+  memset (seg_d, 'd', sizeof seg_d);
+  memcpy (buf, seg_a, 300);
+  memcpy (buf + 300, seg_b, 1000);
+  memcpy (buf + 1300, seg_c, 1);
+  memcpy (buf + 1301, seg_d, 749);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+
+  set_iov (&iov[0], seg_a, sizeof seg_a);
+  set_iov (&iov[1], seg_b, sizeof seg_b);
+  set_iov (&iov[2], NULL, 0);
+  set_iov (&iov[3], seg_c, sizeof seg_c);
+  set_iov (&iov[4], seg_d, sizeof seg_d);
+  CHECK (writev (fd, iov, 5) == FILE_SIZE, "writev 5 segments to \"a\"");
+  if (tell (fd) != FILE_SIZE)
+    fail ("position of \"a\" is %u, should be %d", tell (fd), FILE_SIZE);
+
+  msg ("seek \"a\" to 0");
+  seek (fd, 0);
+  set_iov (&iov[0], read_a, sizeof read_a);
+  set_iov (&iov[1], read_b, sizeof read_b);
+  set_iov (&iov[2], read_c, sizeof read_c);
+  CHECK (readv (fd, iov, 3) == FILE_SIZE, "readv 3 segments from \"a\"");
+  compare_bytes (read_a, buf, sizeof read_a, 0, "a");
+  compare_bytes (read_b, buf + 100, sizeof read_b, 100, "a");
+  compare_bytes (read_c, buf + 1024, sizeof read_c, 1024, "a");
+  CHECK (readv (fd, iov, 3) == 0, "readv at end of \"a\" (must return 0)");
+
+  msg ("close \"a\"");
+  close (fd);
+
+  check_file ("a", buf, FILE_SIZE);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rwv-segments) begin
+(rwv-segments) create "a"
+(rwv-segments) open "a"
+(rwv-segments) writev 5 segments to "a"
+(rwv-segments) seek "a" to 0
+(rwv-segments) readv 3 segments from "a"
+(rwv-segments) readv at end of "a" (must return 0)
+(rwv-segments) close "a"
+(rwv-segments) open "a" for verification
+(rwv-segments) verified contents of "a"
+(rwv-segments) close "a"
+(rwv-segments) end
+EOF
+pass;
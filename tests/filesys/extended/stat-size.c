@@ -0,0 +1,56 @@
+/* Checks that stat and fstat report the size, type and inode
+   number of files and directories, and that both follow a file as
+   it grows. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1234];
+
+void
+test_main (void) 
+{
+  struct stat st, fst;
+  int fd;
+
+  memset (buf, 's', sizeof buf);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (stat ("a", &st), "stat \"a\"");
+  if (st.size != 0 || st.isdir)
+    fail ("stat \"a\": size %d, isdir %d, should be 0 and 0",
+          st.size, st.isdir);
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  CHECK (fstat (fd, &fst), "fstat \"a\"");
+  if (fst.size != sizeof buf || fst.isdir)
+    fail ("fstat \"a\": size %d, isdir %d, should be %zu and 0",
+          fst.size, fst.isdir, sizeof buf);
+  CHECK (stat ("a", &st), "stat \"a\"");
+  if (st.size != fst.size)
+    fail ("stat \"a\": size %d, but fstat said %d", st.size, fst.size);
+  if (st.inumber != fst.inumber || st.inumber != inumber (fd))
+    fail ("stat, fstat and inumber disagree on \"a\": %d, %d, %d",
+          st.inumber, fst.inumber, inumber (fd));
+  msg ("close \"a\"");
+  close (fd);
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (stat ("d", &st), "stat \"d\"");
+  if (!st.isdir)
+    fail ("stat \"d\": not a directory");
+  CHECK ((fd = open ("d")) > 1, "open \"d\"");
+  CHECK (fstat (fd, &fst), "fstat \"d\"");
+  if (!fst.isdir || fst.inumber != st.inumber)
+    fail ("fstat \"d\": isdir %d, inumber %d, should be 1 and %d",
+          fst.isdir, fst.inumber, st.inumber);
+  msg ("close \"d\"");
+  close (fd);
+
+  CHECK (!stat ("b", &st), "stat \"b\" (must return false)");
+
+  check_file ("a", buf, sizeof buf);
+}
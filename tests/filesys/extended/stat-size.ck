@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(stat-size) begin
+(stat-size) create "a"
+(stat-size) stat "a"
+(stat-size) open "a"
+(stat-size) write "a"
+(stat-size) fstat "a"
+(stat-size) stat "a"
+(stat-size) close "a"
+(stat-size) mkdir "d"
+(stat-size) stat "d"
+(stat-size) open "d"
+(stat-size) fstat "d"
+(stat-size) close "d"
+(stat-size) stat "b" (must return false)
+(stat-size) open "a" for verification
+(stat-size) verified contents of "a"
+(stat-size) close "a"
+(stat-size) end
+EOF
+pass;
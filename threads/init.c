@@ -32,8 +32,12 @@
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
+#include "devices/blktrace.h"
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/iosched.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,6 +56,19 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -blktrace: Number of block requests to trace, or 0 for none. */
+static int blktrace_entries;
+
+/* -ramdisk: Size of RAM disk "ram0" in kB, or 0 for none. */
+static size_t ramdisk_kb;
+
+/* -stripe: Comma-separated block devices to stripe into "md0". */
+static char *stripe_members;
+
+/* -mount: File systems to mount, each as BDEV:DIR. */
+static char *mounts[VOLUME_MAX - 1];
+static int mount_cnt;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -68,6 +85,7 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+static void mount_filesystems (void);
 #endif
 
 int main (void) NO_RETURN;
@@ -122,9 +140,16 @@ main (void)
 
 #ifdef FILESYS
   /* Initialize file system. */
+  if (blktrace_entries > 0)
+    blktrace_init (blktrace_entries);
   ide_init ();
+  if (ramdisk_kb > 0)
+    ramdisk_init (ramdisk_kb);
+  if (stripe_members != NULL)
+    stripe_init (stripe_members);
   locate_block_devices ();
   filesys_init (format_filesys);
+  mount_filesystems ();
   char *root = "/";
   thread_current ()->cwd = &root;
 #endif
@@ -249,6 +274,41 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-blktrace"))
+        {
+          blktrace_entries = value != NULL ? atoi (value) : BLKTRACE_DEFAULT;
+          if (blktrace_entries <= 0)
+            PANIC ("bad block trace size `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          int kb = value != NULL ? atoi (value) : 0;
+          if (kb <= 0)
+            PANIC ("bad RAM disk size `%s' (use -h for help)",
+                   value != NULL ? value : "");
+          ramdisk_kb = kb;
+        }
+      else if (!strcmp (name, "-stripe"))
+        {
+          if (value == NULL || *value == '\0')
+            PANIC ("-stripe needs a list of devices (use -h for help)");
+          stripe_members = value;
+        }
+      else if (!strcmp (name, "-mount"))
+        {
+          if (value == NULL || strchr (value, ':') == NULL)
+            PANIC ("bad mount `%s' (use -h for help)",
+                   value != NULL ? value : "");
+          if (mount_cnt >= VOLUME_MAX - 1)
+            PANIC ("too many mounts (maximum %d)", VOLUME_MAX - 1);
+          mounts[mount_cnt++] = value;
+        }
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !iosched_select (value))
+            PANIC ("unknown I/O scheduler `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -375,6 +435,16 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -blktrace[=N]      Trace last N block requests (default 4096)\n"
+          "                     to file blktrace on scratch device.\n"
+          "  -ramdisk=KB        Create KB-kilobyte RAM disk ram0, for use\n"
+          "                     with -filesys or -scratch.\n"
+          "  -stripe=BDEV,...   Stripe BDEVs (best on different IDE channels)\n"
+          "                     into one device, md0.\n"
+          "  -mount=BDEV:DIR    Mount file system on BDEV on directory DIR,\n"
+          "                     formatting it too with -f.  Up to 3 times.\n"
+          "  -iosched=NAME      Schedule disk requests with NAME: noop,\n"
+          "                     clook or deadline (the default).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -428,4 +498,24 @@ locate_block_device (enum block_type role, const char *name)
       block_set_role (role, block);
     }
 }
+
+/* Mounts the file systems given with -mount, in order. */
+static void
+mount_filesystems (void)
+{
+  int i;
+
+  for (i = 0; i < mount_cnt; i++)
+    {
+      char *save_ptr;
+      char *name = strtok_r (mounts[i], ":", &save_ptr);
+      char *dir = strtok_r (NULL, "", &save_ptr);
+      struct block *block = name != NULL ? block_get_by_name (name) : NULL;
+
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name != NULL ? name : "");
+      if (dir == NULL || !filesys_mount (dir, block, format_filesys))
+        PANIC ("Can't mount %s on %s", name, dir != NULL ? dir : "");
+    }
+}
 #endif
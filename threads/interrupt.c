@@ -1,6 +1,7 @@
 #include "threads/interrupt.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <stdint.h>
 #include <stdio.h>
 #include "threads/flags.h"
@@ -47,6 +48,22 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Deferred work, scheduled by external interrupt handlers with
+   intr_defer() to run after the handler returns.  It runs with
+   interrupts enabled, so that other devices' interrupts are not
+   held up while it does slow things like PIO transfers, but it is
+   still interrupt context, so it may not sleep either.  External
+   interrupts that arrive while it runs are handled at once, but
+   any deferred work they schedule waits its turn, so deferred
+   work never nests.
+
+   Code that runs with interrupts off outside interrupt context,
+   such as a driver starting a request, may schedule deferred work
+   too.  It runs as soon as interrupts are turned back on, as if an
+   interrupt had arrived at that moment. */
+static struct list deferred_list = LIST_INITIALIZER (deferred_list);
+static bool in_deferred;        /* Are we running deferred work? */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -59,6 +76,7 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
 static void unexpected_interrupt (const struct intr_frame *);
+static void run_deferred (void);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -83,12 +101,21 @@ intr_set_level (enum intr_level level)
   return level == INTR_ON ? intr_enable () : intr_disable ();
 }
 
-/* Enables interrupts and returns the previous interrupt status. */
+/* Enables interrupts and returns the previous interrupt status.
+   First runs any deferred work scheduled while they were off. */
 enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  bool yield = false;
+  ASSERT (!in_external_intr);
+
+  if (old_level == INTR_OFF && !in_deferred && !list_empty (&deferred_list))
+    {
+      yield_on_return = false;
+      run_deferred ();
+      yield = yield_on_return;
+    }
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -96,6 +123,8 @@ intr_enable (void)
      Hardware Interrupts". */
   asm volatile ("sti");
 
+  if (yield)
+    thread_yield ();
   return old_level;
 }
 
@@ -123,6 +152,7 @@ intr_init (void)
   /* Initialize interrupt controller. */
   pic_init ();
 
+
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
     idt[i] = make_intr_gate (intr_stubs[i], 0);
@@ -206,18 +236,18 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt or of
+   deferred work, and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_deferred;
 }
 
-/* During processing of an external interrupt, directs the
-   interrupt handler to yield to a new process just before
-   returning from the interrupt.  May not be called at any other
-   time. */
+/* During processing of an external interrupt or of deferred work,
+   directs the interrupt handler to yield to a new process just
+   before returning from the interrupt.  May not be called at any
+   other time. */
 void
 intr_yield_on_return (void) 
 {
@@ -355,10 +385,11 @@ intr_handler (struct intr_frame *frame)
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_deferred)
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -383,9 +414,63 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      /* If this interrupt arrived during deferred work, the
+         outermost handler finishes up for both of them. */
+      if (!in_deferred)
+        {
+          run_deferred ();
+          if (yield_on_return) 
+            thread_yield (); 
+        }
+    }
+}
+
+/* Initializes D to run FUNC, passing AUX, when scheduled with
+   intr_defer(). */
+void
+intr_deferred_init (struct intr_deferred *d, intr_deferred_func *func,
+                    void *aux)
+{
+  d->func = func;
+  d->aux = aux;
+  d->pending = false;
+}
+
+/* Schedules D to run after the current external interrupt handler
+   returns or, outside interrupt context, as soon as interrupts are
+   turned back on.  Does nothing if D is already scheduled and has
+   not yet started running.  Must be called with interrupts off. */
+void
+intr_defer (struct intr_deferred *d)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!d->pending)
+    {
+      d->pending = true;
+      list_push_back (&deferred_list, &d->elem);
+    }
+}
+
+/* Runs each piece of scheduled deferred work, with interrupts
+   enabled, until none is left.  Called with interrupts off, and
+   returns with them off. */
+static void
+run_deferred (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  in_deferred = true;
+  while (!list_empty (&deferred_list))
+    {
+      struct intr_deferred *d = list_entry (list_pop_front (&deferred_list),
+                                            struct intr_deferred, elem);
+      d->pending = false;
+      intr_enable ();
+      d->func (d->aux);
+      intr_disable ();
     }
+  in_deferred = false;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -64,6 +65,21 @@ void intr_register_int (uint8_t vec, int dpl, enum intr_level,
 bool intr_context (void);
 void intr_yield_on_return (void);
 
+/* Deferred work ("bottom half") for an external interrupt
+   handler. */
+typedef void intr_deferred_func (void *aux);
+struct intr_deferred
+  {
+    struct list_elem elem;      /* Element in list of scheduled work. */
+    intr_deferred_func *func;   /* Function to run. */
+    void *aux;                  /* Passed to FUNC. */
+    bool pending;               /* Scheduled but not yet started? */
+  };
+
+void intr_deferred_init (struct intr_deferred *, intr_deferred_func *,
+                         void *aux);
+void intr_defer (struct intr_deferred *);
+
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
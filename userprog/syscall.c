@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <syscall-nr.h>
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
 #include "filesys/directory.h"
@@ -9,6 +10,7 @@
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "lib/kernel/hash.h"
 #include "lib/user/syscall.h"
 #include "threads/interrupt.h"
@@ -22,6 +24,7 @@
 #define ARG_ONE ((int *)f->esp + 1)
 #define ARG_TWO ((int *)f->esp + 2)
 #define ARG_THREE ((int *)f->esp + 3)
+#define ARG_FOUR ((int *)f->esp + 4)
 
 static void syscall_handler (struct intr_frame *);
 void halt (void);
@@ -41,8 +44,24 @@ bool mkdir (const char *);
 bool readdir (int, char *);
 bool isdir (int);
 int inumber (int);
+bool stat (const char *, struct stat *);
+bool fstat (int, struct stat *);
+bool fsync (int);
+void sync (void);
+bool fallocate (int, int, int);
+bool ftruncate (int, int);
+int copy_file_range (int, int, int);
+bool clone (const char *, const char *);
+int pread (int, void *, unsigned, int);
+int pwrite (int, const void *, unsigned, int);
+int readv (int, const struct iovec *, int);
+int writev (int, const struct iovec *, int);
+bool direct_io (int, bool);
+bool blkstat (const char *, struct blkstat *);
 char *abs_path (const char *);
 void check_args (void *, void *, void *);
+void check_buffer (const void *, size_t);
+void check_iov (const struct iovec *, int);
 struct inode *lookup_fd (int);
 
 void
@@ -134,6 +153,65 @@ syscall_handler (struct intr_frame *f UNUSED)
         check_args (ARG_ONE, NULL, NULL);
         f->eax = inumber (*ARG_ONE);
         break;
+      case SYS_STAT:
+        check_args (ARG_ONE, ARG_TWO, NULL);
+        f->eax = stat (*(char **) ARG_ONE, *(struct stat **) ARG_TWO);
+        break;
+      case SYS_FSTAT:
+        check_args (ARG_ONE, ARG_TWO, NULL);
+        f->eax = fstat (*ARG_ONE, *(struct stat **) ARG_TWO);
+        break;
+      case SYS_FSYNC:
+        check_args (ARG_ONE, NULL, NULL);
+        f->eax = fsync (*ARG_ONE);
+        break;
+      case SYS_SYNC:
+        sync ();
+        break;
+      case SYS_FALLOCATE:
+        check_args (ARG_ONE, ARG_TWO, ARG_THREE);
+        f->eax = fallocate (*ARG_ONE, *ARG_TWO, *ARG_THREE);
+        break;
+      case SYS_FTRUNCATE:
+        check_args (ARG_ONE, ARG_TWO, NULL);
+        f->eax = ftruncate (*ARG_ONE, *ARG_TWO);
+        break;
+      case SYS_COPY_FILE_RANGE:
+        check_args (ARG_ONE, ARG_TWO, ARG_THREE);
+        f->eax = copy_file_range (*ARG_ONE, *ARG_TWO, *ARG_THREE);
+        break;
+      case SYS_CLONE:
+        check_args (ARG_ONE, ARG_TWO, NULL);
+        f->eax = clone (*(char **) ARG_ONE, *(char **) ARG_TWO);
+        break;
+      case SYS_PREAD:
+        check_args (ARG_ONE, ARG_TWO, ARG_THREE);
+        check_args (ARG_FOUR, NULL, NULL);
+        f->eax = pread (*ARG_ONE, *(void **) ARG_TWO, *(unsigned *) ARG_THREE,
+                        *ARG_FOUR);
+        break;
+      case SYS_PWRITE:
+        check_args (ARG_ONE, ARG_TWO, ARG_THREE);
+        check_args (ARG_FOUR, NULL, NULL);
+        f->eax = pwrite (*ARG_ONE, *(void **) ARG_TWO, *(unsigned *) ARG_THREE,
+                         *ARG_FOUR);
+        break;
+      case SYS_READV:
+        check_args (ARG_ONE, ARG_TWO, ARG_THREE);
+        f->eax = readv (*ARG_ONE, *(struct iovec **) ARG_TWO, *ARG_THREE);
+        break;
+      case SYS_WRITEV:
+        check_args (ARG_ONE, ARG_TWO, ARG_THREE);
+        f->eax = writev (*ARG_ONE, *(struct iovec **) ARG_TWO, *ARG_THREE);
+        break;
+      case SYS_DIRECT_IO:
+        check_args (ARG_ONE, ARG_TWO, NULL);
+        f->eax = direct_io (*ARG_ONE, *(bool *) ARG_TWO);
+        break;
+      case SYS_BLKSTAT:
+        check_args (ARG_ONE, ARG_TWO, NULL);
+        f->eax = blkstat (*(char **) ARG_ONE, *(struct blkstat **) ARG_TWO);
+        break;
       default:
         exit (-1);
     }
@@ -222,7 +300,9 @@ create (const char *path, unsigned initial_size)
   char *ap = abs_path (path);
 
   lock_acquire (&filesys_lock);
+  journal_begin ();
   bool success = filesys_create (ap, initial_size, false);
+  journal_end ();
   lock_release (&filesys_lock);
 
   return success;
@@ -239,7 +319,9 @@ remove (const char *path)
   char *ap = abs_path (path);
 
   lock_acquire (&filesys_lock);
+  journal_begin ();
   bool success = filesys_remove (ap);
+  journal_end ();
   lock_release (&filesys_lock);
 
   return success;
@@ -369,7 +451,9 @@ write (int fd, const void *buffer, unsigned size)
     exit (-1);
 
   lock_acquire (&filesys_lock);
+  journal_begin ();
   int bytes_written = file_write ((struct file *) inode->object, buffer, size);
+  journal_end ();
   lock_release (&filesys_lock);
 
   return bytes_written;
@@ -427,10 +511,12 @@ void close (int fd)
   hash_delete (t->open_inodes, &lookup.hashelem);
   
   lock_acquire (&filesys_lock);
+  journal_begin ();
   if (inode->isdir)
     dir_close ((struct dir *) inode->object);
   else
     file_close ((struct file *) inode->object);
+  journal_end ();
   lock_release (&filesys_lock);
 }
 
@@ -465,27 +551,41 @@ mkdir (const char *path)
     exit (-1);
 
   char *ap = abs_path (path);
-  //printf ("mkdir: abs_path is %s\n", ap);
-  struct dir *dir = dir_open_root ();
   char *token, *save_ptr;
+  struct inode *inode;
+  bool success = false;
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  struct dir *dir = dir_open_root ();
 
   /* Crawl down the absolute path string. */
-  struct inode *inode = malloc (sizeof inode);
   for (token = strtok_r (ap, "/", &save_ptr);
        token != NULL; token = strtok_r (NULL, "/", &save_ptr))
     {
       if (!dir_lookup (dir, token, &inode))
         {
-	  block_sector_t dir_sector = free_map_allocate_one ();
-          dir_create (dir_sector, 0);
-          dir_add (dir, token, dir_sector, true);
-          return true;
+          block_sector_t dir_sector
+            = free_map_allocate_one_near (inode_get_inumber (dir->inode));
+          if (dir_sector == (block_sector_t) -1)
+            break;
+          success = (dir_create (dir_sector, 0)
+                     && dir_add (dir, token, dir_sector, true));
+          if (!success)
+            free_map_release (dir_sector, 1);
+          break;
         }
 
+      dir_close (dir);
       dir = dir_open (inode);
     }
 
-  return false;
+  dir_close (dir);
+  journal_end ();
+  lock_release (&filesys_lock);
+  free (ap);
+
+  return success;
 }
 
 /* Reads a directory entry from file descriptor fd, which must represent a directory. If successful, stores the null-terminated file name in name, which must have room for READDIR_MAX_LEN + 1 bytes, and returns true. If no entries are left in the directory, returns false.
@@ -525,6 +625,367 @@ inumber (int fd)
   return inode->sector;
 }
 
+/* Stores the size, type and inode number of the file or directory
+   PATH into ST, without opening it.  Returns true if successful,
+   false if PATH does not exist. */
+bool
+stat (const char *path, struct stat *st)
+{
+  struct thread *t = thread_current ();
+
+  if (pagedir_get_page (t->pagedir, path) == NULL
+      || pagedir_get_page (t->pagedir, st) == NULL
+      || pagedir_get_page (t->pagedir, (char *) (st + 1) - 1) == NULL)
+    exit (-1);
+
+  char *ap = abs_path (path);
+  off_t length;
+  bool dir;
+  block_sector_t sector;
+
+  lock_acquire (&filesys_lock);
+  bool success = filesys_stat (ap, &length, &dir, &sector);
+  lock_release (&filesys_lock);
+  free (ap);
+
+  if (success)
+    {
+      st->size = length;
+      st->isdir = dir;
+      st->inumber = sector;
+    }
+  return success;
+}
+
+/* Stores the size, type and inode number of the file or directory
+   open as FD into ST.  Returns true if successful. */
+bool
+fstat (int fd, struct stat *st)
+{
+  struct thread *t = thread_current ();
+
+  if (pagedir_get_page (t->pagedir, st) == NULL
+      || pagedir_get_page (t->pagedir, (char *) (st + 1) - 1) == NULL)
+    exit (-1);
+
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  st->size = inode_length (inode);
+  st->isdir = inode->isdir;
+  st->inumber = inode->sector;
+  lock_release (&filesys_lock);
+
+  return true;
+}
+
+/* Writes the data and metadata of the file open as FD to disk,
+   returning only once they are durable.  This commits the running
+   journal transaction, so it also writes the data of other files
+   whose new blocks or lengths are in it, but not the rest of the
+   buffer cache.  Returns true if successful. */
+bool
+fsync (int fd)
+{
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  inode_sync (inode);
+  lock_release (&filesys_lock);
+
+  return true;
+}
+
+/* Writes all file system changes to disk. */
+void
+sync (void)
+{
+  lock_acquire (&filesys_lock);
+  filesys_sync ();
+  lock_release (&filesys_lock);
+}
+
+/* Reserves disk space for the LEN bytes starting at OFFSET in the
+   file open as FD, so that later writes there need not allocate.
+   The reserved space is not zeroed, and the file's length does not
+   change.  Returns true if successful, false if the range is
+   invalid or the disk is full. */
+bool
+fallocate (int fd, int offset, int len)
+{
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  if (offset < 0 || len < 0 || offset > INT32_MAX - len)
+    return false;
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  bool success = (inode->deny_write_cnt == 0
+                  && inode_allocate (inode, offset, len));
+  journal_end ();
+  lock_release (&filesys_lock);
+
+  return success;
+}
+
+/* Sets the length of the file open as FD to LENGTH bytes, releasing
+   its disk space past the new end of file or filling the new bytes
+   with zeros.  Returns true if successful. */
+bool
+ftruncate (int fd, int length)
+{
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  if (length < 0)
+    return false;
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  bool success = inode_truncate (inode, length);
+  journal_end ();
+  lock_release (&filesys_lock);
+
+  return success;
+}
+
+/* Copies up to LENGTH bytes from open file IN_FD to open file OUT_FD,
+   starting at their current positions, within the kernel, and
+   advances both positions.  Returns the number of bytes copied, which
+   is 0 at end of IN_FD, or -1 if IN_FD and OUT_FD are the same file.
+   A file has only one descriptor, and so only one position, per
+   process, so a copy within one file would always overlap itself;
+   use pread() and pwrite() for that instead. */
+int
+copy_file_range (int in_fd, int out_fd, int length)
+{
+  struct inode *in = lookup_fd (in_fd);
+  struct inode *out = lookup_fd (out_fd);
+  if (in == NULL || out == NULL)
+    exit (-1);
+  if (in->isdir || out->isdir)
+    exit (-1);
+  if (in == out)
+    return -1;
+
+  struct file *in_file = (struct file *) in->object;
+  struct file *out_file = (struct file *) out->object;
+  if (length <= 0)
+    return 0;
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  int bytes_copied = file_copy (out_file, in_file, length);
+  journal_end ();
+  lock_release (&filesys_lock);
+
+  return bytes_copied;
+}
+
+/* Creates the file DST as a copy of the file SRC that shares SRC's
+   disk blocks until either file is modified.  Both paths may be
+   relative or absolute.  Returns true if successful, false
+   otherwise. */
+bool
+clone (const char *src, const char *dst)
+{
+  struct thread *t = thread_current ();
+
+  if (pagedir_get_page (t->pagedir, src) == NULL
+      || pagedir_get_page (t->pagedir, dst) == NULL)
+    exit (-1);
+
+  char *src_ap = abs_path (src);
+  char *dst_ap = abs_path (dst);
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  bool success = filesys_clone (src_ap, dst_ap);
+  journal_end ();
+  lock_release (&filesys_lock);
+  free (src_ap);
+  free (dst_ap);
+
+  return success;
+}
+
+/* Reads SIZE bytes from the file open as FD, starting at byte
+   OFFSET, into BUFFER, without using or changing the file's current
+   position.  Returns the number of bytes actually read (0 at end of
+   file), or -1 if FD is not a file or OFFSET is negative. */
+int
+pread (int fd, void *buffer, unsigned size, int offset)
+{
+  check_buffer (buffer, size);
+
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO || offset < 0)
+    return -1;
+
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  int bytes_read = file_read_at ((struct file *) inode->object, buffer, size,
+                                 offset);
+  lock_release (&filesys_lock);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER to the file open as FD, starting at
+   byte OFFSET, without using or changing the file's current
+   position.  Returns the number of bytes actually written, or -1 if
+   FD is not a file or OFFSET is negative. */
+int
+pwrite (int fd, const void *buffer, unsigned size, int offset)
+{
+  check_buffer (buffer, size);
+
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO || offset < 0)
+    return -1;
+
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  int bytes_written = file_write_at ((struct file *) inode->object, buffer,
+                                     size, offset);
+  journal_end ();
+  lock_release (&filesys_lock);
+
+  return bytes_written;
+}
+
+/* Reads from the file open as FD into the IOV_CNT buffers described
+   by IOV, filling each before moving on to the next.  Returns the
+   number of bytes actually read (0 at end of file), or -1 if FD is
+   not a file. */
+int
+readv (int fd, const struct iovec *iov, int iov_cnt)
+{
+  check_iov (iov, iov_cnt);
+
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return -1;
+
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  int bytes_read = file_readv ((struct file *) inode->object, iov, iov_cnt);
+  lock_release (&filesys_lock);
+
+  return bytes_read;
+}
+
+/* Writes the IOV_CNT buffers described by IOV, one after another, to
+   the open file descriptor FD.  Returns the number of bytes actually
+   written, or -1 if FD is not a file or the console. */
+int
+writev (int fd, const struct iovec *iov, int iov_cnt)
+{
+  check_iov (iov, iov_cnt);
+
+  if (fd == STDOUT_FILENO)
+    {
+      int i, size = 0;
+      for (i = 0; i < iov_cnt; i++)
+        {
+          putbuf (iov[i].iov_base, iov[i].iov_len);
+          size += iov[i].iov_len;
+        }
+      return size;
+    }
+  if (fd == STDIN_FILENO)
+    return -1;
+
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  journal_begin ();
+  int bytes_written = file_writev ((struct file *) inode->object, iov,
+                                   iov_cnt);
+  journal_end ();
+  lock_release (&filesys_lock);
+
+  return bytes_written;
+}
+
+/* Turns uncached I/O on the file open as FD on if ENABLE is true,
+   or off if it is false.  While it is on, reads and writes of whole
+   sectors move directly between the user's buffers and the disk,
+   unless the buffer cache already holds the sector.  Returns true
+   if successful, false if FD is the console. */
+bool
+direct_io (int fd, bool enable)
+{
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return false;
+
+  struct inode *inode = lookup_fd (fd);
+  if (inode == NULL)
+    exit (-1);
+  if (inode->isdir)
+    exit (-1);
+
+  lock_acquire (&filesys_lock);
+  file_set_direct ((struct file *) inode->object, enable);
+  lock_release (&filesys_lock);
+
+  return true;
+}
+
+/* Stores the statistics of the block device named DEVICE, such
+   as "hda", into STATS.  Returns true if successful, false if
+   there is no such device. */
+bool
+blkstat (const char *device, struct blkstat *stats)
+{
+  struct thread *t = thread_current ();
+
+  if (pagedir_get_page (t->pagedir, device) == NULL
+      || pagedir_get_page (t->pagedir, stats) == NULL
+      || pagedir_get_page (t->pagedir, (char *) (stats + 1) - 1) == NULL)
+    exit (-1);
+
+  struct block *block = block_get_by_name (device);
+  if (block == NULL)
+    return false;
+
+  /* Take a snapshot first, so that the user's memory is not
+     touched with interrupts off. */
+  struct blkstat snapshot;
+  block_get_stats (block, &snapshot);
+  *stats = snapshot;
+
+  return true;
+}
+
 /* Verify that the passed syscall arguments are valid pointers.
    If not, exit(-1) the user program with an kernel error. */
 void
@@ -542,6 +1003,51 @@ check_args (void *first, void *second, void *third)
     exit (-1);
 }
 
+/* Verify that the SIZE bytes starting at BUFFER are valid user
+   memory, checking every page from the first byte to the last.  An
+   empty buffer is valid wherever it points.  If not, exit(-1) the
+   user program with a kernel error. */
+void
+check_buffer (const void *buffer, size_t size)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  const char *first = buffer;
+  const char *last = first + size - 1;
+  const char *page;
+
+  if (size == 0)
+    return;
+  if (last < first || pagedir_get_page (pd, first) == NULL)
+    exit (-1);
+
+  for (page = (const char *) pg_round_down (first) + PGSIZE;
+       page <= last; page += PGSIZE)
+    if (pagedir_get_page (pd, page) == NULL)
+      exit (-1);
+}
+
+/* Verify that IOV is a valid array of IOV_CNT iovecs, and that each
+   of them describes valid memory, with a total size that fits in an
+   int.  If not, exit(-1) the user program with a kernel error. */
+void
+check_iov (const struct iovec *iov, int iov_cnt)
+{
+  size_t total = 0;
+  int i;
+
+  if (iov_cnt < 0 || iov_cnt > IOV_MAX)
+    exit (-1);
+  check_buffer (iov, iov_cnt * sizeof *iov);
+
+  for (i = 0; i < iov_cnt; i++)
+    {
+      if (iov[i].iov_len > INT32_MAX - total)
+        exit (-1);
+      check_buffer (iov[i].iov_base, iov[i].iov_len);
+      total += iov[i].iov_len;
+    }
+}
+
 /* Given a file descriptor FD, returns its corresponding inode. If no
    inode is found, return NULL). */
 struct inode *